@@ -2,25 +2,70 @@
 #define EXAMPLES_AUTODIFF_AUTODIFF_H_
 
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iomanip>
 #include <iostream>
-#include <map>
 #include <memory>
-#include <queue>
+#include <new>
 #include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "matrix/thread_pool.h"
+#include "simd_math.h"
+
 #define UNUSED(x) (void)(x)
 
 namespace ad {
 class OpBase;
 class VariableImpl;
+
+// 并行反向传播与多线程Gemm共用同一个线程池
+using ThreadPool = gemm::ThreadPool;
+
+// 反向传播的模式
+// kSymbolic: 伴随值本身也是计算图中的Variable，可以继续对梯度求导
+// kValue: 只在结点上原地累加float伴随值，不创建任何新结点，只能求一阶导数
+enum class GradMode { kSymbolic, kValue };
+
+// 每个op对应的操作码，编译后的计算图（CompiledGraph）用它代替虚函数调用
+enum class OpCode : std::uint8_t {
+  kPlus,
+  kMinus,
+  kMul,
+  kDiv,
+  kNeg,
+  kSin,
+  kCos,
+  kLog,
+  kExp
+};
+
+class CompiledGraph;
+
 class Variable {
  public:
   Variable() = default;
 
   explicit Variable(float value);
 
+  // 常量叶子结点，它的值不能修改，Simplify()会对它做常量折叠
+  static Variable Constant(float value);
+
+  // Variable是结点的引用计数句柄，最后一个引用它的Variable析构时结点即被回收
+  Variable(const Variable& other);
+  Variable(Variable&& other) noexcept;
+  Variable& operator=(Variable other) noexcept;
+  ~Variable();
+
   Variable operator+(const Variable& rhs) const;
   Variable operator-(const Variable& rhs) const;
   Variable operator*(const Variable& rhs) const;
@@ -33,10 +78,17 @@ class Variable {
 
   explicit operator bool() { return variable_ != nullptr; }
 
+  // 只重新计算dirty的结点，其余结点直接使用缓存的值
   float Value();
 
+  // 返回缓存的值，不做任何计算，结点为dirty时它可能已经过期
   float Value() const;
 
+  // 修改叶子结点的值，并把所有下游结点标记为dirty
+  void SetValue(float value);
+
+  bool IsConstant() const;
+
   std::string Name() const;
 
   Variable& Inputs(std::size_t i);
@@ -45,11 +97,15 @@ class Variable {
 
   const Variable& Inputs(std::size_t i) const;
 
-  std::shared_ptr<OpBase> Op();
+  const OpBase* Op() const;
 
-  const std::shared_ptr<OpBase> Op() const;
+  void Backpropagation(GradMode mode = GradMode::kSymbolic);
 
-  void Backpropagation();
+  // 在线程池上并行执行的GradMode::kValue反向传播，结果通过GetAdjointValue()读取
+  void Backpropagation(ThreadPool& pool);
+
+  // 把以当前结点为root的计算图编译为线性的指令序列，定义在compiled_graph.h中
+  CompiledGraph Compile() const;
 
   std::string GetTopoGraph();
 
@@ -57,54 +113,260 @@ class Variable {
 
   const Variable GetAdjoint() const;
 
+  // GradMode::kValue模式下累加得到的伴随值
+  float GetAdjointValue() const;
+
   bool operator==(const Variable& rhs) { return rhs.variable_ == variable_; }
 
+  // 对以roots为root的计算图做代数化简，返回与roots一一对应的等价结点：
+  // 常量折叠、恒等式消除（x * 1、x + 0、x - 0、0 - x、x / 1、-(-x)），
+  // 以及按(op, 输入)做公共子表达式消除。非常量的叶子和没有变化的结点直接复用，
+  // 适合化简符号模式得到的梯度计算图
+  static std::vector<Variable> Simplify(const std::vector<Variable>& roots);
+
   static void PrintAllVariablesInPool();
   static void ZeroGradient();
   static void ClearAllVirablesInPool();
 
  private:
+  friend VariableImpl;
+  friend CompiledGraph;
+
   Variable(VariableImpl* var);
 
+  void Retain() const;
+  void Release();
+
+  Variable NewNode(const OpBase* op) const;
+  Variable NewNode(const OpBase* op, const Variable& rhs) const;
+
+  static std::vector<Variable> TopoSort(const Variable& root);
+  static void Evaluate(VariableImpl* root);
+  static void BackpropagationValue(const std::vector<Variable>& sorted_vec);
+
  private:
   VariableImpl* variable_ = nullptr;
+  // 创建句柄时Tape的epoch，Tape被Reset之后旧的句柄不再修改引用计数
+  std::size_t epoch_ = 0;
+};
+
+/*
+ * \brief BasicTape是计算图结点的arena，结点按创建顺序编号，
+ * 并连续存放在定长的chunk中。结点地址在chunk中是稳定的，
+ * Variable可以继续使用裸指针引用结点。
+ * 结点的名字由编号按需生成，创建结点时不再构造std::string。
+ *
+ * \note Release()把单个结点放回空闲链表，之后的NewVariable优先复用它。
+ * Reset()只把size_归零并增加epoch，时间复杂度为O(1)，
+ * 之前的所有Variable随即失效。
+ * 已构造的结点会在之后的NewVariable中被原地复用，其析构推迟到Tape析构时。
+ *
+ * Node需要提供构造函数Node(index, args...)、Reinit(index, args...)、
+ * NumInputs()、InputNode(i)以及index_、visit_mark_成员。
+ */
+template <typename Node>
+class BasicTape {
+ public:
+  static constexpr std::size_t kChunkSize = 4096;
+
+  BasicTape() = default;
+  BasicTape(const BasicTape&) = delete;
+  BasicTape& operator=(const BasicTape&) = delete;
+
+  template <typename... Args>
+  Node* NewVariable(Args&&... args) {
+    if (!free_list_.empty()) {
+      Node* var = At(free_list_.back());
+      free_list_.pop_back();
+      var->Reinit(var->index_, std::forward<Args>(args)...);
+      return var;
+    }
+    if (size_ < constructed_) {
+      Node* var = At(size_);
+      var->Reinit(size_, std::forward<Args>(args)...);
+      ++size_;
+      return var;
+    }
+    if (size_ == chunks_.size() * kChunkSize) {
+      chunks_.emplace_back(new Slot[kChunkSize]);
+    }
+    auto* var = new (SlotAt(size_)) Node{size_, std::forward<Args>(args)...};
+    ++size_;
+    ++constructed_;
+    return var;
+  }
+
+  Node* At(std::size_t index) {
+    return std::launder(reinterpret_cast<Node*>(SlotAt(index)));
+  }
+
+  // 曾经分配过的slot数，结点的编号总是小于它
+  std::size_t Size() const { return size_; }
+
+  // 仍然存活的结点数
+  std::size_t NumLive() const { return size_ - free_list_.size(); }
+
+  std::size_t Epoch() const { return epoch_; }
+
+  // 调用者需要先释放结点持有的资源，slot会在之后的NewVariable中被复用
+  void Release(Node* node) { free_list_.push_back(node->index_); }
+
+  void Reset() {
+    size_ = 0;
+    free_list_.clear();
+    ++epoch_;
+  }
+
+  // 迭代式DFS，借助visit_mark_保证每个结点只访问一次，复杂度为O(V+E)
+  // 按后序对每个结点调用一次visit(node)，调用时它的所有输入都已经被访问过
+  template <typename Visitor>
+  void PostOrder(Node* root, Visitor&& visit) {
+    // 每次遍历取一个新的标记值，结点的visit_mark_等于它时即为已访问，无需清空
+    const std::size_t mark = ++visit_mark_;
+    std::vector<std::pair<Node*, std::size_t>> stack;
+    root->visit_mark_ = mark;
+    stack.emplace_back(root, 0);
+    while (!stack.empty()) {
+      auto& [node, next_input] = stack.back();
+      if (next_input == node->NumInputs()) {
+        visit(node);
+        stack.pop_back();
+        continue;
+      }
+      Node* input = node->InputNode(next_input++);
+      if (input->visit_mark_ != mark) {
+        input->visit_mark_ = mark;
+        stack.emplace_back(input, 0);
+      }
+    }
+  }
+
+  // 后序遍历得到的序列中，输入总在使用它的结点之前，逆序后root排在最前面
+  std::vector<Node*> TopoSort(Node* root) {
+    std::vector<Node*> sorted_vec;
+    PostOrder(root, [&sorted_vec](Node* node) { sorted_vec.push_back(node); });
+    std::reverse(sorted_vec.begin(), sorted_vec.end());
+    return sorted_vec;
+  }
+
+  ~BasicTape() {
+    // 结点中的句柄随结点一起析构，先使它们全部失效，
+    // 避免在析构过程中修改引用计数
+    ++epoch_;
+    for (std::size_t i = 0; i < constructed_; ++i) {
+      At(i)->~Node();
+    }
+  }
+
+ private:
+  struct alignas(Node) Slot {
+    unsigned char bytes[sizeof(Node)];
+  };
+
+  Slot* SlotAt(std::size_t index) {
+    return &chunks_[index / kChunkSize][index % kChunkSize];
+  }
+
+  std::vector<std::unique_ptr<Slot[]>> chunks_;
+  std::vector<std::size_t> free_list_;
+  std::size_t size_ = 0;
+  std::size_t constructed_ = 0;
+  std::size_t visit_mark_ = 0;
+  std::size_t epoch_ = 1;
 };
 
+class VariableImpl;
+using Tape = BasicTape<VariableImpl>;
+
 class VariableImpl {
   friend Variable;
+  friend CompiledGraph;
+  friend Tape;
 
  public:
   VariableImpl(const VariableImpl&) = delete;
   VariableImpl& operator=(const VariableImpl&) = delete;
 
-  static VariableImpl* NewVariable(float value) {
-    std::string name = "v" + std::to_string(variable_pool_.size());
-    variable_pool_[name] =
-        std::unique_ptr<VariableImpl>(new VariableImpl{name, value});
-    return variable_pool_[name].get();
-  }
-  static std::map<std::string, std::unique_ptr<VariableImpl>> variable_pool_;
+  static VariableImpl* NewVariable(float value);
+  // 每个线程有自己的Tape，各线程可以无锁地并行建图和求导，
+  // Variable不能跨线程使用，静态的清理接口也只作用于当前线程的Tape
+  static thread_local Tape tape_;
 
  private:
-  explicit VariableImpl(const std::string& name, float value = .0F)
-      : name_(name), cached_value_(value) {}
+  VariableImpl(std::size_t index, float value)
+      : index_(index), cached_value_(value) {}
+
+  // 用已经计算好的输入值更新cached_value_
+  void Compute();
+
+  // 回收引用计数归零的结点，并迭代地回收因此变得不可达的输入和伴随值结点
+  static void Destroy(VariableImpl* root);
+
+  // 复用Tape上已经构造过的结点，保留inputs_等容器已分配的容量
+  void Reinit(std::size_t index, float value) {
+    inputs_.clear();
+    consumers_.clear();
+    adjoint_ = Variable();
+    adjoint_vec_.clear();
+    op_ = nullptr;
+    visit_mark_ = 0;
+    adjoint_value_ = .0F;
+    pass_adjoint_ = .0F;
+    index_ = index;
+    cached_value_ = value;
+    dirty_ = false;
+    constant_ = false;
+    ref_count_ = 0;
+  }
+
+  std::size_t NumInputs() const { return inputs_.size(); }
+
+  VariableImpl* InputNode(std::size_t i) const { return inputs_[i].variable_; }
+
   std::vector<Variable> inputs_;
+  // 使用该结点作为输入的结点，用于把dirty标记传播到下游
+  std::vector<VariableImpl*> consumers_;
   Variable adjoint_;
   std::vector<Variable> adjoint_vec_;
-  std::shared_ptr<OpBase> op_;
-  std::string name_;
+  const OpBase* op_ = nullptr;
+  std::size_t index_;
+  std::size_t visit_mark_ = 0;
   float cached_value_;
+  // cached_value_是否需要重新计算。dirty结点的所有下游结点一定也是dirty的，
+  // 反之clean结点的所有输入一定是clean的
+  bool dirty_ = false;
+  // 由Variable::Constant()创建的叶子
+  bool constant_ = false;
+  // GradMode::kValue: adjoint_value_在多次反向传播之间累加，
+  // pass_adjoint_只记录当前这一次反向传播的伴随值
+  float adjoint_value_ = .0F;
+  float pass_adjoint_ = .0F;
+  // 引用该结点的Variable的个数，Tape是线程私有的，不需要原子操作
+  std::uint32_t ref_count_ = 0;
 };
 
-std::map<std::string, std::unique_ptr<VariableImpl>>
-    VariableImpl::variable_pool_;
+thread_local Tape VariableImpl::tape_;
+
+VariableImpl* VariableImpl::NewVariable(float value) {
+  return tape_.NewVariable(value);
+}
 
 class OpBase {
  public:
   OpBase(const char* name) : op_name_(name) {}
-  virtual float Compute(std::vector<Variable>& inputs) const = 0;
+  // 逐元素地计算n个值，inputs[i]指向第i个输入的n个值，结果写入output
+  // 标量的Variable即为n=1的情况
+  virtual void Compute(const float* const* inputs, float* output,
+                       std::size_t n) const = 0;
+  // 符号梯度，返回的伴随值仍然是计算图中的Variable
   virtual std::vector<Variable> Gradient(const std::vector<Variable> inputs,
                                          Variable out_adjoint) const = 0;
+  // 数值梯度，根据输入值、输出值和输出的伴随值，
+  // 把各个输入的伴随值累加到input_adjoints[i]中，两个输入可能指向同一块内存
+  virtual void Gradient(const float* const* inputs, const float* output,
+                        const float* out_adjoint, float* const* input_adjoints,
+                        std::size_t n) const = 0;
+  virtual OpCode Code() const = 0;
   std::string GetName() const { return op_name_; };
   virtual ~OpBase() = default;
 
@@ -116,135 +378,461 @@ class PlusOp : public OpBase {
   using OpBase::OpBase;
 
  public:
-  float Compute(std::vector<Variable>& inputs) const final;
+  OpCode Code() const final { return OpCode::kPlus; }
+  void Compute(const float* const* inputs, float* output,
+               std::size_t n) const final;
   std::vector<Variable> Gradient(const std::vector<Variable> inputs,
                                  Variable out_adjoint) const final;
+  void Gradient(const float* const* inputs, const float* output,
+                const float* out_adjoint, float* const* input_adjoints,
+                std::size_t n) const final;
 };
 
 class MinusOp : public OpBase {
   using OpBase::OpBase;
 
  public:
-  float Compute(std::vector<Variable>& inputs) const final;
+  OpCode Code() const final { return OpCode::kMinus; }
+  void Compute(const float* const* inputs, float* output,
+               std::size_t n) const final;
   std::vector<Variable> Gradient(const std::vector<Variable> inputs,
                                  Variable out_adjoint) const final;
+  void Gradient(const float* const* inputs, const float* output,
+                const float* out_adjoint, float* const* input_adjoints,
+                std::size_t n) const final;
 };
 
 class MultipleOp : public OpBase {
   using OpBase::OpBase;
 
  public:
-  float Compute(std::vector<Variable>& inputs) const final;
+  OpCode Code() const final { return OpCode::kMul; }
+  void Compute(const float* const* inputs, float* output,
+               std::size_t n) const final;
   std::vector<Variable> Gradient(const std::vector<Variable> inputs,
                                  Variable out_adjoint) const final;
+  void Gradient(const float* const* inputs, const float* output,
+                const float* out_adjoint, float* const* input_adjoints,
+                std::size_t n) const final;
 };
 
 class DivideOp : public OpBase {
   using OpBase::OpBase;
 
  public:
-  float Compute(std::vector<Variable>& inputs) const final;
+  OpCode Code() const final { return OpCode::kDiv; }
+  void Compute(const float* const* inputs, float* output,
+               std::size_t n) const final;
   std::vector<Variable> Gradient(const std::vector<Variable> inputs,
                                  Variable out_adjoint) const final;
+  void Gradient(const float* const* inputs, const float* output,
+                const float* out_adjoint, float* const* input_adjoints,
+                std::size_t n) const final;
 };
 
 class SinOp : public OpBase {
   using OpBase::OpBase;
 
  public:
-  float Compute(std::vector<Variable>& inputs) const final;
+  OpCode Code() const final { return OpCode::kSin; }
+  void Compute(const float* const* inputs, float* output,
+               std::size_t n) const final;
   std::vector<Variable> Gradient(const std::vector<Variable> inputs,
                                  Variable out_adjoint) const final;
+  void Gradient(const float* const* inputs, const float* output,
+                const float* out_adjoint, float* const* input_adjoints,
+                std::size_t n) const final;
 };
 
 class CosOp : public OpBase {
   using OpBase::OpBase;
 
  public:
-  float Compute(std::vector<Variable>& inputs) const final;
+  OpCode Code() const final { return OpCode::kCos; }
+  void Compute(const float* const* inputs, float* output,
+               std::size_t n) const final;
   std::vector<Variable> Gradient(const std::vector<Variable> inputs,
                                  Variable out_adjoint) const final;
+  void Gradient(const float* const* inputs, const float* output,
+                const float* out_adjoint, float* const* input_adjoints,
+                std::size_t n) const final;
 };
 
 class LogOp : public OpBase {
   using OpBase::OpBase;
 
  public:
-  float Compute(std::vector<Variable>& inputs) const final;
+  OpCode Code() const final { return OpCode::kLog; }
+  void Compute(const float* const* inputs, float* output,
+               std::size_t n) const final;
   std::vector<Variable> Gradient(const std::vector<Variable> inputs,
                                  Variable out_adjoint) const final;
+  void Gradient(const float* const* inputs, const float* output,
+                const float* out_adjoint, float* const* input_adjoints,
+                std::size_t n) const final;
 };
 
 class ExpOp : public OpBase {
   using OpBase::OpBase;
 
  public:
-  float Compute(std::vector<Variable>& inputs) const final;
+  OpCode Code() const final { return OpCode::kExp; }
+  void Compute(const float* const* inputs, float* output,
+               std::size_t n) const final;
   std::vector<Variable> Gradient(const std::vector<Variable> inputs,
                                  Variable out_adjoint) const final;
+  void Gradient(const float* const* inputs, const float* output,
+                const float* out_adjoint, float* const* input_adjoints,
+                std::size_t n) const final;
 };
 
 class Negitive : public OpBase {
   using OpBase::OpBase;
 
  public:
-  float Compute(std::vector<Variable>& inputs) const final;
+  OpCode Code() const final { return OpCode::kNeg; }
+  void Compute(const float* const* inputs, float* output,
+               std::size_t n) const final;
   std::vector<Variable> Gradient(const std::vector<Variable> inputs,
                                  Variable out_adjoint) const final;
+  void Gradient(const float* const* inputs, const float* output,
+                const float* out_adjoint, float* const* input_adjoints,
+                std::size_t n) const final;
+};
+
+// op都是无状态的，同一种op的所有结点共享一个实例，
+// 创建结点时不再分配op对象，也没有shared_ptr引用计数的开销。
+// MatrixVariable的op同样通过它获取
+template <typename Op>
+const Op* GetOp(const char* name) {
+  static const Op op(name);
+  return &op;
+}
+
+// 性能剖析的开关：编译时定义AD_PROFILE，下面的宏才会统计op的结点数、
+// 调用次数与耗时，否则它们展开为空，没有任何运行时开销
+#ifdef AD_PROFILE
+#define AD_PROFILE_OP(op, phase) \
+  ::ad::ProfileScope ad_profile_op((op), ::ad::ProfilePhase::phase)
+#define AD_PROFILE_REGION(name) ::ad::ProfileScope ad_profile_region(name)
+#define AD_PROFILE_NODE(op) ::ad::Profiler::Get().RecordNode(op)
+#else
+#define AD_PROFILE_OP(op, phase)
+#define AD_PROFILE_REGION(name)
+#define AD_PROFILE_NODE(op)
+#endif
+
+enum class ProfilePhase { kForward, kGradient };
+
+/*
+ * \brief Profiler按op统计创建的结点数、前向与梯度的调用次数和耗时，
+ * 同时按时间顺序记录每次调用，可以输出为Chrome trace的JSON格式，
+ * 用chrome://tracing或Perfetto查看一步训练中各个op的分布。
+ *
+ * \note Profiler与Tape一样是thread_local的，只统计当前线程上执行的op，
+ * 线程池上的并行反向传播只记录整体的耗时。Variable与BatchVariable共享op，
+ * 它们的统计合并在一起。trace事件最多记录kMaxTraceEvents个，之后只做汇总。
+ */
+class Profiler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr std::size_t kNumOps =
+      static_cast<std::size_t>(OpCode::kExp) + 1;
+  static constexpr std::size_t kMaxTraceEvents = 1 << 20;
+
+  struct OpStats {
+    std::string name;
+    std::uint64_t num_nodes = 0;
+    std::uint64_t num_forward = 0;
+    std::uint64_t num_gradient = 0;
+    Clock::duration forward_time{};
+    Clock::duration gradient_time{};
+  };
+
+  static Profiler& Get() {
+    static thread_local Profiler profiler;
+    return profiler;
+  }
+
+  void RecordNode(const OpBase* op) { ++StatsOf(op).num_nodes; }
+
+  void RecordOp(const OpBase* op, ProfilePhase phase, Clock::time_point start,
+                Clock::time_point end);
+
+  void RecordRegion(const char* name, Clock::time_point start,
+                    Clock::time_point end) {
+    AddEvent(name, "region", start, end);
+  }
+
+  // 以OpCode为下标，没有出现过的op名字为空
+  const std::array<OpStats, kNumOps>& Stats() const { return stats_; }
+
+  // 按前向与梯度的总耗时从高到低排列的文本报告
+  std::string Report() const;
+
+  // 每次调用是一个"X"事件，时间以微秒为单位，从Profiler创建或Reset()时算起
+  void WriteChromeTrace(std::ostream& out) const;
+
+  void Reset() {
+    events_.clear();
+    stats_ = {};
+    origin_ = Clock::now();
+  }
+
+ private:
+  struct Event {
+    const char* name;
+    const char* category;
+    Clock::time_point start;
+    Clock::duration duration;
+  };
+
+  OpStats& StatsOf(const OpBase* op) {
+    OpStats& stats = stats_[static_cast<std::size_t>(op->Code())];
+    if (stats.name.empty()) {
+      stats.name = op->GetName();
+    }
+    return stats;
+  }
+
+  void AddEvent(const char* name, const char* category,
+                Clock::time_point start, Clock::time_point end) {
+    if (events_.size() < kMaxTraceEvents) {
+      events_.push_back({name, category, start, end - start});
+    }
+  }
+
+  std::array<OpStats, kNumOps> stats_;
+  std::vector<Event> events_;
+  Clock::time_point origin_ = Clock::now();
+};
+
+// 在析构时把构造以来的耗时记录到当前线程的Profiler中
+class ProfileScope {
+ public:
+  ProfileScope(const OpBase* op, ProfilePhase phase)
+      : op_(op), phase_(phase), start_(Profiler::Clock::now()) {}
+
+  explicit ProfileScope(const char* name)
+      : name_(name), start_(Profiler::Clock::now()) {}
+
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+  ~ProfileScope() {
+    const auto end = Profiler::Clock::now();
+    if (op_) {
+      Profiler::Get().RecordOp(op_, phase_, start_, end);
+    } else {
+      Profiler::Get().RecordRegion(name_, start_, end);
+    }
+  }
+
+ private:
+  const OpBase* op_ = nullptr;
+  const char* name_ = nullptr;
+  ProfilePhase phase_ = ProfilePhase::kForward;
+  Profiler::Clock::time_point start_;
 };
 
-Variable::Variable(VariableImpl* var) : variable_(var) {}
+void Profiler::RecordOp(const OpBase* op, ProfilePhase phase,
+                        Clock::time_point start, Clock::time_point end) {
+  OpStats& stats = StatsOf(op);
+  if (phase == ProfilePhase::kForward) {
+    ++stats.num_forward;
+    stats.forward_time += end - start;
+    AddEvent(stats.name.c_str(), "forward", start, end);
+  } else {
+    ++stats.num_gradient;
+    stats.gradient_time += end - start;
+    AddEvent(stats.name.c_str(), "gradient", start, end);
+  }
+}
+
+std::string Profiler::Report() const {
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+  std::vector<const OpStats*> sorted_stats;
+  Clock::duration total_time{};
+  for (const auto& stats : stats_) {
+    if (!stats.name.empty()) {
+      sorted_stats.push_back(&stats);
+      total_time += stats.forward_time + stats.gradient_time;
+    }
+  }
+  std::sort(sorted_stats.begin(), sorted_stats.end(),
+            [](const OpStats* lhs, const OpStats* rhs) {
+              return lhs->forward_time + lhs->gradient_time >
+                     rhs->forward_time + rhs->gradient_time;
+            });
+  std::ostringstream report;
+  report << std::left << std::setw(8) << "op" << std::right << std::setw(12)
+         << "nodes" << std::setw(12) << "forward" << std::setw(14)
+         << "forward ms" << std::setw(12) << "gradient" << std::setw(14)
+         << "gradient ms" << std::setw(10) << "share" << std::endl;
+  report << std::fixed << std::setprecision(3);
+  for (const OpStats* stats : sorted_stats) {
+    const auto time = stats->forward_time + stats->gradient_time;
+    const double share =
+        total_time.count() > 0
+            ? 100.0 * static_cast<double>(time.count()) /
+                  static_cast<double>(total_time.count())
+            : .0;
+    report << std::left << std::setw(8) << stats->name << std::right
+           << std::setw(12) << stats->num_nodes << std::setw(12)
+           << stats->num_forward << std::setw(14)
+           << Milliseconds(stats->forward_time).count() << std::setw(12)
+           << stats->num_gradient << std::setw(14)
+           << Milliseconds(stats->gradient_time).count() << std::setw(9)
+           << share << "%" << std::endl;
+  }
+  return report.str();
+}
+
+void Profiler::WriteChromeTrace(std::ostream& out) const {
+  using Microseconds = std::chrono::duration<double, std::micro>;
+  out << "{\"traceEvents\":[";
+  out << std::fixed << std::setprecision(3);
+  for (std::size_t i = 0; i < events_.size(); ++i) {
+    const Event& event = events_[i];
+    out << (i == 0 ? "\n" : ",\n") << "{\"name\":\"" << event.name
+        << "\",\"cat\":\"" << event.category
+        << "\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":"
+        << Microseconds(event.start - origin_).count()
+        << ",\"dur\":" << Microseconds(event.duration).count() << "}";
+  }
+  out << "\n]}" << std::endl;
+}
+
+Variable::Variable(VariableImpl* var)
+    : variable_(var), epoch_(VariableImpl::tape_.Epoch()) {
+  Retain();
+}
+
+Variable::Variable(float value)
+    : Variable(VariableImpl::NewVariable(value)) {}
+
+Variable Variable::Constant(float value) {
+  Variable var{value};
+  var.variable_->constant_ = true;
+  return var;
+}
+
+Variable::Variable(const Variable& other)
+    : variable_(other.variable_), epoch_(other.epoch_) {
+  Retain();
+}
+
+Variable::Variable(Variable&& other) noexcept
+    : variable_(other.variable_), epoch_(other.epoch_) {
+  other.variable_ = nullptr;
+}
 
-Variable::Variable(float value) {
-  variable_ = VariableImpl::NewVariable(value);
+Variable& Variable::operator=(Variable other) noexcept {
+  std::swap(variable_, other.variable_);
+  std::swap(epoch_, other.epoch_);
+  return *this;
+}
+
+Variable::~Variable() { Release(); }
+
+void Variable::Retain() const {
+  if (variable_ && epoch_ == VariableImpl::tape_.Epoch()) {
+    ++variable_->ref_count_;
+  }
+}
+
+void Variable::Release() {
+  if (variable_ && epoch_ == VariableImpl::tape_.Epoch() &&
+      --variable_->ref_count_ == 0) {
+    VariableImpl::Destroy(variable_);
+  }
+  variable_ = nullptr;
+}
+
+void VariableImpl::Destroy(VariableImpl* root) {
+  // 不递归地析构句柄，而是把引用计数归零的结点放入栈中，避免长链上的深递归。
+  // 栈上的结点都已经不可达，不会有句柄在此期间被析构，所以可以复用同一个栈
+  static thread_local std::vector<VariableImpl*> stack;
+  auto drop = [](Variable& handle) {
+    VariableImpl* node = handle.variable_;
+    handle.variable_ = nullptr;
+    if (node && --node->ref_count_ == 0) {
+      stack.push_back(node);
+    }
+  };
+  stack.push_back(root);
+  while (!stack.empty()) {
+    VariableImpl* var = stack.back();
+    stack.pop_back();
+    for (auto& input : var->inputs_) {
+      // 临时结点通常按创建的逆序被回收，从后向前查找一般只需要常数时间
+      auto& consumers = input.variable_->consumers_;
+      auto iter = std::find(consumers.rbegin(), consumers.rend(), var);
+      *iter = consumers.back();
+      consumers.pop_back();
+      drop(input);
+    }
+    for (auto& adjoint : var->adjoint_vec_) {
+      drop(adjoint);
+    }
+    drop(var->adjoint_);
+    var->inputs_.clear();
+    var->adjoint_vec_.clear();
+    var->consumers_.clear();
+    tape_.Release(var);
+  }
 }
 
 void Variable::PrintAllVariablesInPool() {
-  for (const auto& var : VariableImpl::variable_pool_) {
-    std::cout << var.second->name_;
-    if (var.second->inputs_.size() == 0) {
+  for (std::size_t i = 0; i < VariableImpl::tape_.Size(); ++i) {
+    if (VariableImpl::tape_.At(i)->ref_count_ == 0) {
+      continue;
+    }
+    Variable var{VariableImpl::tape_.At(i)};
+    std::cout << var.Name();
+    if (var.NumInputs() == 0) {
       std::cout << std::endl;
-    } else if (var.second->inputs_.size() == 1) {
-      std::cout << ": " << var.second->op_->GetName()
-                << var.second->inputs_[0].Name() << std::endl;
-    } else if (var.second->inputs_.size() == 2) {
-      std::cout << ": " << var.second->inputs_[0].Name()
-                << var.second->op_->GetName() << var.second->inputs_[1].Name()
+    } else if (var.NumInputs() == 1) {
+      std::cout << ": " << var.Op()->GetName() << var.Inputs(0).Name()
                 << std::endl;
+    } else if (var.NumInputs() == 2) {
+      std::cout << ": " << var.Inputs(0).Name() << var.Op()->GetName()
+                << var.Inputs(1).Name() << std::endl;
     }
   }
 }
 
-void Variable::ClearAllVirablesInPool() {
-  VariableImpl::variable_pool_.clear();
-}
+void Variable::ClearAllVirablesInPool() { VariableImpl::tape_.Reset(); }
 
+// 符号模式的伴随值可能引用结点本身，例如sin(x)使x的伴随值依赖cos(x)，
+// 这样的环会使引用计数无法归零。清空梯度时把已有的伴随值固定为常数，
+// 断开伴随值计算图与原计算图之间的引用
 void Variable::ZeroGradient() {
-  for (auto& var : VariableImpl::variable_pool_) {
-    var.second->adjoint_vec_.clear();
+  for (std::size_t i = 0; i < VariableImpl::tape_.Size(); ++i) {
+    VariableImpl* var = VariableImpl::tape_.At(i);
+    if (var->ref_count_ == 0) {
+      continue;
+    }
+    var->adjoint_value_ = .0F;
+    // 先把句柄移出结点，它们在本次迭代结束时析构，届时var本身也可能被回收
+    std::vector<Variable> adjoint_vec = std::move(var->adjoint_vec_);
+    var->adjoint_vec_.clear();
+    Variable adjoint = std::move(var->adjoint_);
+    if (adjoint) {
+      var->adjoint_ = Constant(adjoint.Value());
+    }
   }
 }
-namespace {
-std::vector<Variable> TopoSort(Variable root) {
-  std::queue<Variable> q;
-  q.push(root);
+std::vector<Variable> Variable::TopoSort(const Variable& root) {
   std::vector<Variable> sorted_vec;
-  while (!q.empty()) {
-    auto ref = q.front();
-    for (std::size_t i = 0; i < ref.NumInputs(); ++i) {
-      q.push(ref.Inputs(i));
-    }
-    auto iter = std::find(sorted_vec.begin(), sorted_vec.end(), ref);
-    // 如果已经在前面出现了，则需要把它调整到尾声部来
-    if (iter != sorted_vec.end()) {
-      sorted_vec.erase(iter);
-    }
-    sorted_vec.push_back(ref);
-    q.pop();
+  for (VariableImpl* node : VariableImpl::tape_.TopoSort(root.variable_)) {
+    sorted_vec.push_back(Variable{node});
   }
   return sorted_vec;
 }
 
+namespace {
 std::string GetNodeName(const Variable& node) {
   if (node.Op()) {
     return node.Name() + "[\"" + node.Name() + ": " + node.Op()->GetName() +
@@ -267,13 +855,207 @@ std::string Variable::GetTopoGraph() {
   return printer.str();
 }
 
-void Variable::Backpropagation() {
-  std::vector<Variable> sorted_vec = TopoSort(*this);
-  std::cout << std::endl;
-  auto all_refs = sorted_vec;
+void VariableImpl::Compute() {
+  AD_PROFILE_OP(op_, kForward);
+  const float* input_values[2];
+  for (std::size_t j = 0; j < inputs_.size(); ++j) {
+    input_values[j] = &InputNode(j)->cached_value_;
+  }
+  op_->Compute(input_values, &cached_value_, 1);
+  dirty_ = false;
+}
+
+// 从root出发做迭代式DFS，只进入dirty的输入，后序地计算每个结点，
+// 每个dirty结点只计算一次，clean的结点不会被访问，复杂度为O(受影响的结点数)
+void Variable::Evaluate(VariableImpl* root) {
+  AD_PROFILE_REGION("Evaluate");
+  std::vector<std::pair<VariableImpl*, std::size_t>> stack;
+  stack.emplace_back(root, 0);
+  while (!stack.empty()) {
+    auto& [node, next_input] = stack.back();
+    if (next_input == node->NumInputs()) {
+      node->Compute();
+      stack.pop_back();
+      continue;
+    }
+    VariableImpl* input = node->InputNode(next_input++);
+    if (input->dirty_) {
+      stack.emplace_back(input, 0);
+    }
+  }
+}
+
+void Variable::BackpropagationValue(const std::vector<Variable>& sorted_vec) {
+  VariableImpl* root = sorted_vec.front().variable_;
+  if (root->dirty_) {
+    Evaluate(root);
+  }
+  for (const auto& node : sorted_vec) {
+    node.variable_->pass_adjoint_ = .0F;
+  }
+  sorted_vec.front().variable_->pass_adjoint_ = 1.0F;
+  for (const auto& node : sorted_vec) {
+    VariableImpl* var = node.variable_;
+    var->adjoint_value_ += var->pass_adjoint_;
+    if (var->op_ == nullptr) {
+      continue;
+    }
+    const float* input_values[2];
+    float* input_adjoints[2];
+    for (std::size_t j = 0; j < var->inputs_.size(); ++j) {
+      input_values[j] = &var->inputs_[j].variable_->cached_value_;
+      input_adjoints[j] = &var->inputs_[j].variable_->pass_adjoint_;
+    }
+    AD_PROFILE_OP(var->op_, kGradient);
+    var->op_->Gradient(input_values, &var->cached_value_, &var->pass_adjoint_,
+                       input_adjoints, 1);
+  }
+}
+
+// 结点按到root的最长路径长度分层，同一层的结点之间没有依赖，可以并行处理。
+// 结点的值和输入编号先收集到连续的数组中，前向计算从最深的一层开始，
+// 反向传播从root所在的第0层开始。每条边有自己的伴随值槽位，结点只写
+// 自己的输出边，处理到某个结点时再把所有指向它的边上的伴随值归约起来，
+// 整个过程不需要任何同步原语，最后再把结果写回各个结点。
+void Variable::Backpropagation(ThreadPool& pool) {
+  AD_PROFILE_REGION("ParallelBackpropagation");
+  // 结点数较少的层在调用线程上直接执行，避免线程同步的开销
+  constexpr std::size_t kMinParallelNodes = 256;
+
+  // 按后序给结点编号，编号为i的结点的输入编号都小于i，root的编号最大。
+  // 遍历的同时把结点的op、值和输入编号收集到连续的数组中，
+  // 第i个结点的第j条输入边编号为2 * i + j
+  std::vector<std::uint32_t> local_ids(VariableImpl::tape_.Size());
+  std::vector<VariableImpl*> nodes;
+  std::vector<const OpBase*> ops;
+  std::vector<float> values;
+  std::vector<char> dirty;
+  std::vector<std::uint8_t> num_inputs;
+  std::vector<std::uint32_t> inputs;
+  VariableImpl::tape_.PostOrder(variable_, [&](VariableImpl* var) {
+    local_ids[var->index_] = static_cast<std::uint32_t>(nodes.size());
+    nodes.push_back(var);
+    ops.push_back(var->op_);
+    values.push_back(var->cached_value_);
+    dirty.push_back(var->dirty_);
+    num_inputs.push_back(static_cast<std::uint8_t>(var->NumInputs()));
+    for (std::size_t j = 0; j < 2; ++j) {
+      inputs.push_back(
+          j < var->NumInputs() ? local_ids[var->InputNode(j)->index_] : 0);
+    }
+  });
+  const std::size_t num_nodes = nodes.size();
+  const std::size_t root = num_nodes - 1;
+
+  // 逆后序中使用者总是排在输入之前，一次遍历即可得到到root的最长路径长度
+  std::vector<std::uint32_t> levels(num_nodes, 0);
+  std::vector<std::uint32_t> in_edge_begin(num_nodes + 1, 0);
+  for (std::size_t i = num_nodes; i-- > 0;) {
+    for (std::size_t j = 0; j < num_inputs[i]; ++j) {
+      const std::uint32_t input = inputs[2 * i + j];
+      levels[input] = std::max(levels[input], levels[i] + 1);
+      ++in_edge_begin[input + 1];
+    }
+  }
+  for (std::size_t i = 0; i < num_nodes; ++i) {
+    in_edge_begin[i + 1] += in_edge_begin[i];
+  }
+  std::vector<std::uint32_t> in_edges(in_edge_begin.back());
+  std::vector<std::uint32_t> in_edge_end(in_edge_begin.begin(),
+                                         in_edge_begin.end() - 1);
+  for (std::size_t i = 0; i < num_nodes; ++i) {
+    for (std::size_t j = 0; j < num_inputs[i]; ++j) {
+      in_edges[in_edge_end[inputs[2 * i + j]]++] =
+          static_cast<std::uint32_t>(2 * i + j);
+    }
+  }
+
+  // 按层号做计数排序，第l层的结点为order[level_begin[l], level_begin[l + 1])
+  const std::uint32_t num_levels =
+      *std::max_element(levels.begin(), levels.end()) + 1;
+  std::vector<std::uint32_t> level_begin(num_levels + 1, 0);
+  for (std::uint32_t level : levels) {
+    ++level_begin[level + 1];
+  }
+  for (std::uint32_t l = 0; l < num_levels; ++l) {
+    level_begin[l + 1] += level_begin[l];
+  }
+  std::vector<std::uint32_t> order(num_nodes);
+  std::vector<std::uint32_t> level_end(level_begin.begin(),
+                                       level_begin.end() - 1);
+  for (std::size_t i = 0; i < num_nodes; ++i) {
+    order[level_end[levels[i]]++] = static_cast<std::uint32_t>(i);
+  }
+
+  auto parallel_for = [&pool](std::size_t n, const auto& fn) {
+    auto chunk = [&fn](std::size_t begin, std::size_t end) {
+      for (std::size_t k = begin; k < end; ++k) {
+        fn(k);
+      }
+    };
+    if (n < kMinParallelNodes) {
+      chunk(0, n);
+    } else {
+      pool.ParallelFor(n, chunk);
+    }
+  };
+  auto run_level = [&parallel_for, &order, &level_begin](std::uint32_t level,
+                                                         const auto& fn) {
+    const std::size_t begin = level_begin[level];
+    parallel_for(level_begin[level + 1] - begin,
+                 [&fn, &order, begin](std::size_t k) { fn(order[begin + k]); });
+  };
+
+  for (std::uint32_t level = num_levels; level-- > 0;) {
+    run_level(level, [&](std::uint32_t i) {
+      if (!dirty[i]) {
+        return;
+      }
+      const float* input_values[2] = {&values[inputs[2 * i]],
+                                      &values[inputs[2 * i + 1]]};
+      ops[i]->Compute(input_values, &values[i], 1);
+    });
+  }
+
+  std::vector<float> edge_adjoints(2 * num_nodes, .0F);
+  std::vector<float> adjoints(num_nodes);
+  for (std::uint32_t level = 0; level < num_levels; ++level) {
+    run_level(level, [&](std::uint32_t i) {
+      float adjoint = i == root ? 1.0F : .0F;
+      for (std::uint32_t e = in_edge_begin[i]; e < in_edge_begin[i + 1]; ++e) {
+        adjoint += edge_adjoints[in_edges[e]];
+      }
+      adjoints[i] = adjoint;
+      if (ops[i] == nullptr) {
+        return;
+      }
+      const float* input_values[2] = {&values[inputs[2 * i]],
+                                      &values[inputs[2 * i + 1]]};
+      float* input_adjoints[2] = {&edge_adjoints[2 * i],
+                                  &edge_adjoints[2 * i + 1]};
+      ops[i]->Gradient(input_values, &values[i], &adjoints[i], input_adjoints,
+                       1);
+    });
+  }
+
+  parallel_for(num_nodes, [&](std::size_t i) {
+    VariableImpl* var = nodes[i];
+    var->cached_value_ = values[i];
+    var->dirty_ = false;
+    var->adjoint_value_ += adjoints[i];
+  });
+}
+
+void Variable::Backpropagation(GradMode mode) {
+  AD_PROFILE_REGION("Backpropagation");
+  std::vector<Variable> all_refs = TopoSort(*this);
+  if (mode == GradMode::kValue) {
+    BackpropagationValue(all_refs);
+    return;
+  }
   for (std::size_t i = 0; i < all_refs.size(); ++i) {
     if (all_refs[i].variable_->adjoint_vec_.empty()) {
-      all_refs[i].variable_->adjoint_vec_.emplace_back(1.0F);
+      all_refs[i].variable_->adjoint_vec_.push_back(Constant(1.0F));
     }
     all_refs[i].variable_->adjoint_ =
         all_refs[i].variable_->adjoint_vec_.front();
@@ -285,6 +1067,7 @@ void Variable::Backpropagation() {
     if (all_refs[i].Op() == nullptr) {
       continue;
     }
+    AD_PROFILE_OP(all_refs[i].Op(), kGradient);
     auto gradients = all_refs[i].Op()->Gradient(
         all_refs[i].variable_->inputs_, all_refs[i].variable_->adjoint_);
     for (std::size_t j = 0; j < gradients.size(); ++j) {
@@ -294,92 +1077,246 @@ void Variable::Backpropagation() {
   }
 }
 
-Variable Variable::operator+(const Variable& rhs) const {
-  auto op = std::make_shared<PlusOp>("plus");
+Variable Variable::NewNode(const OpBase* op) const {
+  AD_PROFILE_NODE(op);
   auto var_ref = Variable(.0F);
   var_ref.variable_->op_ = op;
   var_ref.variable_->inputs_.emplace_back(*this);
-  var_ref.variable_->inputs_.emplace_back(rhs);
+  var_ref.variable_->dirty_ = true;
+  variable_->consumers_.push_back(var_ref.variable_);
   return var_ref;
 }
 
-Variable Variable::operator-(const Variable& rhs) const {
-  auto op = std::make_shared<MinusOp>("minus");
+Variable Variable::NewNode(const OpBase* op,
+                           const Variable& rhs) const {
+  AD_PROFILE_NODE(op);
   auto var_ref = Variable(.0F);
   var_ref.variable_->op_ = op;
   var_ref.variable_->inputs_.emplace_back(*this);
   var_ref.variable_->inputs_.emplace_back(rhs);
+  var_ref.variable_->dirty_ = true;
+  variable_->consumers_.push_back(var_ref.variable_);
+  rhs.variable_->consumers_.push_back(var_ref.variable_);
   return var_ref;
 }
 
+Variable Variable::operator+(const Variable& rhs) const {
+  return NewNode(GetOp<PlusOp>("plus"), rhs);
+}
+
+Variable Variable::operator-(const Variable& rhs) const {
+  return NewNode(GetOp<MinusOp>("minus"), rhs);
+}
+
 Variable Variable::operator*(const Variable& rhs) const {
-  auto op = std::make_shared<MultipleOp>("mul");
-  auto var_ref = Variable(.0F);
-  var_ref.variable_->op_ = op;
-  var_ref.variable_->inputs_.emplace_back(*this);
-  var_ref.variable_->inputs_.emplace_back(rhs);
-  return var_ref;
+  return NewNode(GetOp<MultipleOp>("mul"), rhs);
 }
 
 Variable Variable::operator/(const Variable& rhs) const {
-  auto op = std::make_shared<DivideOp>("div");
-  auto var_ref = Variable(.0F);
-  var_ref.variable_->op_ = op;
-  var_ref.variable_->inputs_.emplace_back(*this);
-  var_ref.variable_->inputs_.emplace_back(rhs);
-  return var_ref;
+  return NewNode(GetOp<DivideOp>("div"), rhs);
 }
 
 Variable Variable::operator-() const {
-  auto op = std::make_shared<Negitive>("neg");
-  auto var_ref = Variable(.0F);
-  var_ref.variable_->op_ = op;
-  var_ref.variable_->inputs_.emplace_back(*this);
-  return var_ref;
+  return NewNode(GetOp<Negitive>("neg"));
 }
 
 Variable Variable::Sin() const {
-  auto op = std::make_shared<SinOp>("sin");
-  auto var_ref = Variable(.0F);
-  var_ref.variable_->op_ = op;
-  var_ref.variable_->inputs_.emplace_back(*this);
-  return var_ref;
+  return NewNode(GetOp<SinOp>("sin"));
 }
 
 Variable Variable::Cos() const {
-  auto op = std::make_shared<CosOp>("cos");
-  auto var_ref = Variable(.0F);
-  var_ref.variable_->op_ = op;
-  var_ref.variable_->inputs_.emplace_back(*this);
-  return var_ref;
+  return NewNode(GetOp<CosOp>("cos"));
 }
 
 Variable Variable::Log() const {
-  auto op = std::make_shared<LogOp>("log");
-  auto var_ref = Variable(.0F);
-  var_ref.variable_->op_ = op;
-  var_ref.variable_->inputs_.emplace_back(*this);
-  return var_ref;
+  return NewNode(GetOp<LogOp>("log"));
 }
 
 Variable Variable::Exp() const {
-  auto op = std::make_shared<ExpOp>("exp");
-  auto var_ref = Variable(.0F);
-  var_ref.variable_->op_ = op;
-  var_ref.variable_->inputs_.emplace_back(*this);
-  return var_ref;
+  return NewNode(GetOp<ExpOp>("exp"));
+}
+
+namespace {
+// 公共子表达式的键，单目运算的rhs为空
+struct ExprKey {
+  OpCode code;
+  const VariableImpl* lhs;
+  const VariableImpl* rhs;
+
+  bool operator==(const ExprKey& other) const {
+    return code == other.code && lhs == other.lhs && rhs == other.rhs;
+  }
+};
+
+struct ExprKeyHash {
+  std::size_t operator()(const ExprKey& key) const {
+    std::size_t hash = std::hash<const void*>()(key.lhs);
+    hash = hash * 31 + std::hash<const void*>()(key.rhs);
+    return hash * 31 + static_cast<std::size_t>(key.code);
+  }
+};
+}  // namespace
+
+std::vector<Variable> Variable::Simplify(const std::vector<Variable>& roots) {
+  // 以原结点在Tape中的编号为下标，记录化简后的等价结点
+  std::vector<Variable> mapped(VariableImpl::tape_.Size());
+  std::unordered_map<ExprKey, Variable, ExprKeyHash> exprs;
+  // 值相同的常量只保留一个，以float的二进制表示为键
+  std::unordered_map<std::uint32_t, Variable> constants;
+
+  auto constant = [&constants](float value, VariableImpl* original) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    Variable& var = constants[bits];
+    if (!var) {
+      var = original ? Variable{original} : Constant(value);
+    }
+    return var;
+  };
+  auto is_constant = [](const Variable& var, float value) {
+    return var.variable_->constant_ &&
+           std::equal_to<float>()(var.variable_->cached_value_, value);
+  };
+  // 查找相同的表达式，没有时优先复用输入没有变化的原结点，否则创建新结点。
+  // 可交换的op把输入按结点编号排序，a + b与b + a得到同一个键
+  auto lookup = [&exprs](const OpBase* op, const Variable& lhs,
+                         const Variable* rhs, VariableImpl* original) {
+    ExprKey key{op->Code(), lhs.variable_, rhs ? rhs->variable_ : nullptr};
+    if ((key.code == OpCode::kPlus || key.code == OpCode::kMul) &&
+        key.rhs->index_ < key.lhs->index_) {
+      std::swap(key.lhs, key.rhs);
+    }
+    Variable& var = exprs[key];
+    if (!var) {
+      const bool unchanged =
+          original && original->InputNode(0) == lhs.variable_ &&
+          (rhs == nullptr || original->InputNode(1) == rhs->variable_);
+      if (unchanged) {
+        var = Variable{original};
+      } else {
+        var = rhs ? lhs.NewNode(op, *rhs) : lhs.NewNode(op);
+      }
+    }
+    return var;
+  };
+  auto unary = [&](const OpBase* op, const Variable& x,
+                   VariableImpl* original) {
+    if (x.variable_->constant_) {
+      const float* input_values[1] = {&x.variable_->cached_value_};
+      float value;
+      op->Compute(input_values, &value, 1);
+      return constant(value, nullptr);
+    }
+    if (op->Code() == OpCode::kNeg && x.variable_->op_ &&
+        x.variable_->op_->Code() == OpCode::kNeg) {
+      return x.variable_->inputs_[0];
+    }
+    return lookup(op, x, nullptr, original);
+  };
+  auto binary = [&](const OpBase* op, const Variable& x, const Variable& y,
+                    VariableImpl* original) {
+    if (x.variable_->constant_ && y.variable_->constant_) {
+      const float* input_values[2] = {&x.variable_->cached_value_,
+                                      &y.variable_->cached_value_};
+      float value;
+      op->Compute(input_values, &value, 1);
+      return constant(value, nullptr);
+    }
+    switch (op->Code()) {
+      case OpCode::kPlus:
+        if (is_constant(x, 0)) {
+          return y;
+        }
+        if (is_constant(y, 0)) {
+          return x;
+        }
+        break;
+      case OpCode::kMinus:
+        if (is_constant(y, 0)) {
+          return x;
+        }
+        if (is_constant(x, 0)) {
+          return unary(GetOp<Negitive>("neg"), y, nullptr);
+        }
+        break;
+      case OpCode::kMul:
+        if (is_constant(x, 1)) {
+          return y;
+        }
+        if (is_constant(y, 1)) {
+          return x;
+        }
+        break;
+      case OpCode::kDiv:
+        if (is_constant(y, 1)) {
+          return x;
+        }
+        break;
+      default:
+        break;
+    }
+    return lookup(op, x, &y, original);
+  };
+
+  std::vector<Variable> results;
+  for (const auto& root : roots) {
+    VariableImpl::tape_.PostOrder(root.variable_, [&](VariableImpl* var) {
+      Variable& result = mapped[var->index_];
+      if (result) {
+        return;
+      }
+      if (var->op_ == nullptr) {
+        result = var->constant_ ? constant(var->cached_value_, var)
+                                : Variable{var};
+      } else if (var->NumInputs() == 1) {
+        result = unary(var->op_, mapped[var->InputNode(0)->index_], var);
+      } else {
+        result = binary(var->op_, mapped[var->InputNode(0)->index_],
+                        mapped[var->InputNode(1)->index_], var);
+      }
+    });
+    results.push_back(mapped[root.variable_->index_]);
+  }
+  return results;
 }
 
 float Variable::Value() {
-  if (variable_->op_) {
-    variable_->cached_value_ = variable_->op_->Compute(variable_->inputs_);
+  if (variable_->dirty_) {
+    Evaluate(variable_);
   }
   return variable_->cached_value_;
 }
 
 float Variable::Value() const { return variable_->cached_value_; }
 
-std::string Variable::Name() const { return variable_->name_; }
+void Variable::SetValue(float value) {
+  if (variable_->op_) {
+    throw std::invalid_argument("Only leaf variables can be assigned");
+  }
+  if (variable_->constant_) {
+    throw std::invalid_argument("Constant variables cannot be assigned");
+  }
+  variable_->cached_value_ = value;
+  std::vector<VariableImpl*> stack(variable_->consumers_.begin(),
+                                   variable_->consumers_.end());
+  while (!stack.empty()) {
+    VariableImpl* node = stack.back();
+    stack.pop_back();
+    // 已经是dirty的结点，它的下游也一定都是dirty的，不需要继续传播
+    if (node->dirty_) {
+      continue;
+    }
+    node->dirty_ = true;
+    stack.insert(stack.end(), node->consumers_.begin(),
+                 node->consumers_.end());
+  }
+}
+
+bool Variable::IsConstant() const { return variable_->constant_; }
+
+std::string Variable::Name() const {
+  return "v" + std::to_string(variable_->index_);
+}
 
 Variable& Variable::Inputs(std::size_t i) { return variable_->inputs_[i]; }
 
@@ -389,9 +1326,7 @@ const Variable& Variable::Inputs(std::size_t i) const {
   return variable_->inputs_[i];
 }
 
-std::shared_ptr<OpBase> Variable::Op() { return variable_->op_; }
-
-const std::shared_ptr<OpBase> Variable::Op() const { return variable_->op_; }
+const OpBase* Variable::Op() const { return variable_->op_; }
 
 Variable Variable::GetAdjoint() {
   if (variable_->adjoint_) {
@@ -407,8 +1342,15 @@ const Variable Variable::GetAdjoint() const {
   throw std::invalid_argument("Run backward before get adjoint");
 }
 
-float PlusOp::Compute(std::vector<Variable>& inputs) const {
-  return inputs[0].Value() + inputs[1].Value();
+float Variable::GetAdjointValue() const { return variable_->adjoint_value_; }
+
+void PlusOp::Compute(const float* const* inputs, float* output,
+                     std::size_t n) const {
+  const float* x = inputs[0];
+  const float* y = inputs[1];
+  for (std::size_t i = 0; i < n; ++i) {
+    output[i] = x[i] + y[i];
+  }
 }
 
 std::vector<Variable> PlusOp::Gradient(const std::vector<Variable> inputs,
@@ -417,8 +1359,26 @@ std::vector<Variable> PlusOp::Gradient(const std::vector<Variable> inputs,
   return {out_adjoint, out_adjoint};
 }
 
-float MinusOp::Compute(std::vector<Variable>& inputs) const {
-  return inputs[0].Value() - inputs[1].Value();
+void PlusOp::Gradient(const float* const* inputs, const float* output,
+                      const float* out_adjoint, float* const* input_adjoints,
+                      std::size_t n) const {
+  UNUSED(inputs);
+  UNUSED(output);
+  float* dx = input_adjoints[0];
+  float* dy = input_adjoints[1];
+  for (std::size_t i = 0; i < n; ++i) {
+    dx[i] += out_adjoint[i];
+    dy[i] += out_adjoint[i];
+  }
+}
+
+void MinusOp::Compute(const float* const* inputs, float* output,
+                      std::size_t n) const {
+  const float* x = inputs[0];
+  const float* y = inputs[1];
+  for (std::size_t i = 0; i < n; ++i) {
+    output[i] = x[i] - y[i];
+  }
 }
 
 std::vector<Variable> MinusOp::Gradient(const std::vector<Variable> inputs,
@@ -427,8 +1387,26 @@ std::vector<Variable> MinusOp::Gradient(const std::vector<Variable> inputs,
   return {out_adjoint, -out_adjoint};
 }
 
-float MultipleOp::Compute(std::vector<Variable>& inputs) const {
-  return inputs[0].Value() * inputs[1].Value();
+void MinusOp::Gradient(const float* const* inputs, const float* output,
+                       const float* out_adjoint, float* const* input_adjoints,
+                       std::size_t n) const {
+  UNUSED(inputs);
+  UNUSED(output);
+  float* dx = input_adjoints[0];
+  float* dy = input_adjoints[1];
+  for (std::size_t i = 0; i < n; ++i) {
+    dx[i] += out_adjoint[i];
+    dy[i] -= out_adjoint[i];
+  }
+}
+
+void MultipleOp::Compute(const float* const* inputs, float* output,
+                         std::size_t n) const {
+  const float* x = inputs[0];
+  const float* y = inputs[1];
+  for (std::size_t i = 0; i < n; ++i) {
+    output[i] = x[i] * y[i];
+  }
 }
 
 std::vector<Variable> MultipleOp::Gradient(const std::vector<Variable> inputs,
@@ -436,8 +1414,27 @@ std::vector<Variable> MultipleOp::Gradient(const std::vector<Variable> inputs,
   return {out_adjoint * inputs[1], out_adjoint * inputs[0]};
 }
 
-float DivideOp::Compute(std::vector<Variable>& inputs) const {
-  return inputs[0].Value() / inputs[1].Value();
+void MultipleOp::Gradient(const float* const* inputs, const float* output,
+                          const float* out_adjoint,
+                          float* const* input_adjoints, std::size_t n) const {
+  UNUSED(output);
+  const float* x = inputs[0];
+  const float* y = inputs[1];
+  float* dx = input_adjoints[0];
+  float* dy = input_adjoints[1];
+  for (std::size_t i = 0; i < n; ++i) {
+    dx[i] += out_adjoint[i] * y[i];
+    dy[i] += out_adjoint[i] * x[i];
+  }
+}
+
+void DivideOp::Compute(const float* const* inputs, float* output,
+                       std::size_t n) const {
+  const float* x = inputs[0];
+  const float* y = inputs[1];
+  for (std::size_t i = 0; i < n; ++i) {
+    output[i] = x[i] / y[i];
+  }
 }
 
 std::vector<Variable> DivideOp::Gradient(const std::vector<Variable> inputs,
@@ -446,8 +1443,22 @@ std::vector<Variable> DivideOp::Gradient(const std::vector<Variable> inputs,
           -inputs[0] * out_adjoint / (inputs[1] * inputs[1])};
 }
 
-float SinOp::Compute(std::vector<Variable>& inputs) const {
-  return std::sin(inputs[0].Value());
+void DivideOp::Gradient(const float* const* inputs, const float* output,
+                        const float* out_adjoint, float* const* input_adjoints,
+                        std::size_t n) const {
+  const float* y = inputs[1];
+  float* dx = input_adjoints[0];
+  float* dy = input_adjoints[1];
+  for (std::size_t i = 0; i < n; ++i) {
+    dx[i] += out_adjoint[i] / y[i];
+    dy[i] -= out_adjoint[i] * output[i] / y[i];
+  }
+}
+
+void SinOp::Compute(const float* const* inputs, float* output,
+                    std::size_t n) const {
+  const float* x = inputs[0];
+  simd::Sin(x, output, n);
 }
 
 std::vector<Variable> SinOp::Gradient(const std::vector<Variable> inputs,
@@ -455,8 +1466,19 @@ std::vector<Variable> SinOp::Gradient(const std::vector<Variable> inputs,
   return {out_adjoint * inputs[0].Cos()};
 }
 
-float CosOp::Compute(std::vector<Variable>& inputs) const {
-  return std::cos(inputs[0].Value());
+void SinOp::Gradient(const float* const* inputs, const float* output,
+                     const float* out_adjoint, float* const* input_adjoints,
+                     std::size_t n) const {
+  UNUSED(output);
+  const float* x = inputs[0];
+  float* dx = input_adjoints[0];
+  simd::AccumulateCos(x, out_adjoint, dx, n);
+}
+
+void CosOp::Compute(const float* const* inputs, float* output,
+                    std::size_t n) const {
+  const float* x = inputs[0];
+  simd::Cos(x, output, n);
 }
 
 std::vector<Variable> CosOp::Gradient(const std::vector<Variable> inputs,
@@ -464,8 +1486,19 @@ std::vector<Variable> CosOp::Gradient(const std::vector<Variable> inputs,
   return {out_adjoint * -inputs[0].Sin()};
 }
 
-float LogOp::Compute(std::vector<Variable>& inputs) const {
-  return std::log(inputs[0].Value());
+void CosOp::Gradient(const float* const* inputs, const float* output,
+                     const float* out_adjoint, float* const* input_adjoints,
+                     std::size_t n) const {
+  UNUSED(output);
+  const float* x = inputs[0];
+  float* dx = input_adjoints[0];
+  simd::AccumulateNegSin(x, out_adjoint, dx, n);
+}
+
+void LogOp::Compute(const float* const* inputs, float* output,
+                    std::size_t n) const {
+  const float* x = inputs[0];
+  simd::Log(x, output, n);
 }
 
 std::vector<Variable> LogOp::Gradient(const std::vector<Variable> inputs,
@@ -473,8 +1506,21 @@ std::vector<Variable> LogOp::Gradient(const std::vector<Variable> inputs,
   return {out_adjoint / inputs[0]};
 }
 
-float ExpOp::Compute(std::vector<Variable>& inputs) const {
-  return std::exp(inputs[0].Value());
+void LogOp::Gradient(const float* const* inputs, const float* output,
+                     const float* out_adjoint, float* const* input_adjoints,
+                     std::size_t n) const {
+  UNUSED(output);
+  const float* x = inputs[0];
+  float* dx = input_adjoints[0];
+  for (std::size_t i = 0; i < n; ++i) {
+    dx[i] += out_adjoint[i] / x[i];
+  }
+}
+
+void ExpOp::Compute(const float* const* inputs, float* output,
+                    std::size_t n) const {
+  const float* x = inputs[0];
+  simd::Exp(x, output, n);
 }
 
 std::vector<Variable> ExpOp::Gradient(const std::vector<Variable> inputs,
@@ -482,8 +1528,22 @@ std::vector<Variable> ExpOp::Gradient(const std::vector<Variable> inputs,
   return {out_adjoint * inputs[0].Exp()};
 }
 
-float Negitive::Compute(std::vector<Variable>& inputs) const {
-  return -inputs[0].Value();
+void ExpOp::Gradient(const float* const* inputs, const float* output,
+                     const float* out_adjoint, float* const* input_adjoints,
+                     std::size_t n) const {
+  UNUSED(inputs);
+  float* dx = input_adjoints[0];
+  for (std::size_t i = 0; i < n; ++i) {
+    dx[i] += out_adjoint[i] * output[i];
+  }
+}
+
+void Negitive::Compute(const float* const* inputs, float* output,
+                       std::size_t n) const {
+  const float* x = inputs[0];
+  for (std::size_t i = 0; i < n; ++i) {
+    output[i] = -x[i];
+  }
 }
 
 std::vector<Variable> Negitive::Gradient(const std::vector<Variable> inputs,
@@ -492,6 +1552,17 @@ std::vector<Variable> Negitive::Gradient(const std::vector<Variable> inputs,
   return {-out_adjoint};
 }
 
+void Negitive::Gradient(const float* const* inputs, const float* output,
+                        const float* out_adjoint, float* const* input_adjoints,
+                        std::size_t n) const {
+  UNUSED(inputs);
+  UNUSED(output);
+  float* dx = input_adjoints[0];
+  for (std::size_t i = 0; i < n; ++i) {
+    dx[i] -= out_adjoint[i];
+  }
+}
+
 }  // namespace ad
 
 #endif  // EXAMPLES_AUTODIFF_AUTODIFF_H_
@@ -0,0 +1,644 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "autodiff.h"
+#include "batch_variable.h"
+#include "compiled_graph.h"
+#include "dual.h"
+#include "hessian.h"
+#include "matrix_variable.h"
+#include "rosenbrock.h"
+
+// 链式结构: x_{i+1} = x_i * c，每个结点只有一条路径通往root
+ad::Variable BuildChain(std::size_t num_nodes) {
+  auto c = ad::Variable{1.0001F};
+  auto x = ad::Variable{1};
+  for (std::size_t i = 0; i < num_nodes; ++i) {
+    x = x * c;
+  }
+  return x;
+}
+
+// 树形结构: 对num_nodes个叶子两两求和，直到只剩下一个结点
+ad::Variable BuildTree(std::size_t num_nodes) {
+  std::vector<ad::Variable> level;
+  for (std::size_t i = 0; i < num_nodes; ++i) {
+    level.emplace_back(static_cast<float>(i));
+  }
+  while (level.size() > 1) {
+    std::vector<ad::Variable> next;
+    for (std::size_t i = 0; i + 1 < level.size(); i += 2) {
+      next.push_back(level[i] + level[i + 1]);
+    }
+    if (level.size() % 2 == 1) {
+      next.push_back(level.back());
+    }
+    level.swap(next);
+  }
+  return level.front();
+}
+
+// 菱形结构: x_{i+1} = x_i * x_i + x_i，从root到叶子的路径数随深度指数增长
+ad::Variable BuildDiamond(std::size_t num_nodes) {
+  auto x = ad::Variable{0.5F};
+  for (std::size_t i = 0; i < num_nodes / 2; ++i) {
+    x = x * x + x;
+  }
+  return x;
+}
+
+// 对batch_size个样本求模型sin(w * x + b) * exp(-x)关于w、b的梯度，
+// 比较逐样本建图与一次性建一个批量计算图的耗时
+void BenchmarkBatch(std::size_t batch_size, int num_runs) {
+  std::vector<float> xs(batch_size);
+  for (std::size_t i = 0; i < batch_size; ++i) {
+    xs[i] = static_cast<float>(i) / static_cast<float>(batch_size);
+  }
+
+  double scalar_time = 0.0;
+  double batch_time = 0.0;
+  for (int run = 0; run < num_runs; ++run) {
+    ad::Variable::ClearAllVirablesInPool();
+    auto start = std::chrono::high_resolution_clock::now();
+    auto w = ad::Variable{0.3F};
+    auto b = ad::Variable{-1.0F};
+    for (float x_value : xs) {
+      auto x = ad::Variable{x_value};
+      auto y = (w * x + b).Sin() * (-x).Exp();
+      y.Backpropagation(ad::GradMode::kValue);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> diff = end - start;
+    scalar_time += diff.count();
+
+    ad::BatchVariable::ClearAllVirablesInPool();
+    start = std::chrono::high_resolution_clock::now();
+    auto batch_w = ad::BatchVariable{{0.3F}};
+    auto batch_b = ad::BatchVariable{{-1.0F}};
+    auto batch_x = ad::BatchVariable{xs};
+    auto batch_y = (batch_w * batch_x + batch_b).Sin() * (-batch_x).Exp();
+    batch_y.Backpropagation();
+    end = std::chrono::high_resolution_clock::now();
+    diff = end - start;
+    batch_time += diff.count();
+  }
+  std::cout << "batch=" << batch_size
+            << " per-sample graphs: " << scalar_time / num_runs
+            << " ms, batched graph: " << batch_time / num_runs << " ms"
+            << std::endl;
+}
+
+// 建图的吞吐量：每轮交替使用二元和一元op创建num_nodes个结点，不做任何计算
+void BenchmarkConstruction(std::size_t num_nodes, int num_runs) {
+  double total_time = 0.0;
+  for (int run = 0; run < num_runs; ++run) {
+    ad::Variable::ClearAllVirablesInPool();
+    auto start = std::chrono::high_resolution_clock::now();
+    auto c = ad::Variable{0.5F};
+    auto x = ad::Variable{1};
+    for (std::size_t i = 0; i < num_nodes / 2; ++i) {
+      x = (x * c).Sin();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> diff = end - start;
+    total_time += diff.count();
+  }
+  double avg_time = total_time / num_runs;
+  std::cout << "construction nodes=" << num_nodes << ": " << avg_time
+            << " ms, " << avg_time * 1e6 / static_cast<double>(num_nodes)
+            << " ns/node" << std::endl;
+}
+
+// 多个线程各自在自己的Tape上建图并求导，统计每秒完成的计算图数量
+void BenchmarkThreads(std::size_t num_threads, int num_graphs) {
+  auto worker = [num_graphs, num_threads]() {
+    for (std::size_t i = 0; i < num_graphs / num_threads; ++i) {
+      ad::Variable::ClearAllVirablesInPool();
+      auto root = BuildTree(1 << 10);
+      root.Backpropagation(ad::GradMode::kValue);
+    }
+  };
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < num_threads; ++i) {
+    threads.emplace_back(worker);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> diff = end - start;
+  std::cout << "threads=" << num_threads << ": "
+            << static_cast<double>(num_graphs) / diff.count() << " graphs/s"
+            << std::endl;
+}
+
+// 宽模型上的反向传播：单线程的值模式与不同线程数的并行版本
+void BenchmarkParallelBackward(std::size_t max_threads, int num_runs) {
+  constexpr std::size_t kNumLeaves = 1 << 18;
+  double serial_time = 0.0;
+  for (int run = 0; run < num_runs; ++run) {
+    ad::Variable::ClearAllVirablesInPool();
+    auto root = BuildTree(kNumLeaves).Sin();
+    auto start = std::chrono::high_resolution_clock::now();
+    root.Backpropagation(ad::GradMode::kValue);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> diff = end - start;
+    serial_time += diff.count();
+  }
+  std::cout << "wide leaves=" << kNumLeaves
+            << " serial backprop: " << serial_time / num_runs << " ms"
+            << std::endl;
+  for (std::size_t num_threads = 1; num_threads <= max_threads;
+       num_threads *= 2) {
+    ad::ThreadPool pool(num_threads);
+    double total_time = 0.0;
+    for (int run = 0; run < num_runs; ++run) {
+      ad::Variable::ClearAllVirablesInPool();
+      auto root = BuildTree(kNumLeaves).Sin();
+      auto start = std::chrono::high_resolution_clock::now();
+      root.Backpropagation(pool);
+      auto end = std::chrono::high_resolution_clock::now();
+      std::chrono::duration<double, std::milli> diff = end - start;
+      total_time += diff.count();
+    }
+    std::cout << "wide leaves=" << kNumLeaves << " threads=" << num_threads
+              << " parallel backprop: " << total_time / num_runs << " ms"
+              << std::endl;
+  }
+}
+
+// 输入少、输出多的函数 y_k = sin(a_k * x0 + x1) * exp(-a_k * x0)，
+// 求2 x m的Jacobian。反向模式对每个输出做一次反向传播，
+// 前向模式用两个方向的对偶数一次算完
+template <typename T>
+T WideOutput(const T& x0, const T& x1, float a) {
+  return (T(a) * x0 + x1).Sin() * (-(T(a) * x0)).Exp();
+}
+
+void BenchmarkJacobian(std::size_t num_outputs, int num_runs) {
+  double reverse_time = 0.0;
+  double forward_time = 0.0;
+  float checksum = .0F;
+  for (int run = 0; run < num_runs; ++run) {
+    ad::Variable::ClearAllVirablesInPool();
+    auto start = std::chrono::high_resolution_clock::now();
+    auto x0 = ad::Variable{0.3F};
+    auto x1 = ad::Variable{0.7F};
+    std::vector<float> jacobian(2 * num_outputs);
+    for (std::size_t k = 0; k < num_outputs; ++k) {
+      auto y = WideOutput(x0, x1, static_cast<float>(k) * 0.01F);
+      // 叶子的伴随值在多次反向传播之间累加，取增量即为本次输出的梯度
+      const float dx0 = x0.GetAdjointValue();
+      const float dx1 = x1.GetAdjointValue();
+      y.Backpropagation(ad::GradMode::kValue);
+      jacobian[2 * k] = x0.GetAdjointValue() - dx0;
+      jacobian[2 * k + 1] = x1.GetAdjointValue() - dx1;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> diff = end - start;
+    reverse_time += diff.count();
+    checksum += jacobian.back();
+
+    using Dual2 = ad::Dual<float, 2>;
+    start = std::chrono::high_resolution_clock::now();
+    const auto dual_x0 = Dual2::Input(0.3F, 0);
+    const auto dual_x1 = Dual2::Input(0.7F, 1);
+    for (std::size_t k = 0; k < num_outputs; ++k) {
+      auto y = WideOutput(dual_x0, dual_x1, static_cast<float>(k) * 0.01F);
+      jacobian[2 * k] = y.Tangent(0);
+      jacobian[2 * k + 1] = y.Tangent(1);
+    }
+    end = std::chrono::high_resolution_clock::now();
+    diff = end - start;
+    forward_time += diff.count();
+    checksum -= jacobian.back();
+  }
+  std::cout << "jacobian 2x" << num_outputs
+            << " reverse mode: " << reverse_time / num_runs
+            << " ms, forward mode: " << forward_time / num_runs
+            << " ms (checksum " << checksum << ")" << std::endl;
+}
+
+// 长链式的批量计算图，比较不同内存预算下中间结果的峰值内存与耗时
+void BenchmarkCheckpoint(std::size_t num_layers, std::size_t batch_size) {
+  const std::vector<float> xs(batch_size, 0.5F);
+  auto build = [&xs, num_layers]() {
+    auto w = ad::BatchVariable{{0.9F}};
+    auto x = ad::BatchVariable{xs};
+    auto h = x;
+    for (std::size_t i = 0; i < num_layers; ++i) {
+      h = (h * w).Sin() + x;
+    }
+    return h;
+  };
+  // 每层有乘法、sin和加法三个结点
+  const std::size_t full_bytes = 3 * num_layers * batch_size * sizeof(float);
+
+  ad::BatchVariable::ClearAllVirablesInPool();
+  auto root = build();
+  auto start = std::chrono::high_resolution_clock::now();
+  root.Backpropagation();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> diff = end - start;
+  std::cout << "checkpoint layers=" << num_layers << " no checkpoint: "
+            << diff.count() << " ms, values alone " << full_bytes / 1024
+            << " KiB" << std::endl;
+  for (std::size_t divisor : {1, 4, 8}) {
+    ad::BatchVariable::ClearAllVirablesInPool();
+    root = build();
+    start = std::chrono::high_resolution_clock::now();
+    auto stats = root.Backpropagation(full_bytes / divisor);
+    end = std::chrono::high_resolution_clock::now();
+    diff = end - start;
+    std::cout << "checkpoint layers=" << num_layers
+              << " budget=" << full_bytes / divisor / 1024
+              << " KiB: " << diff.count()
+              << " ms, peak " << stats.peak_bytes / 1024 << " KiB, "
+              << stats.num_recomputed << " nodes recomputed" << std::endl;
+  }
+}
+
+// 对num_leaves个叶子求和，每次只修改其中一个叶子后重新求值，
+// 比较全图重算与只重算dirty结点的耗时
+void BenchmarkIncremental(std::size_t num_leaves, int num_runs) {
+  ad::Variable::ClearAllVirablesInPool();
+  std::vector<ad::Variable> leaves;
+  for (std::size_t i = 0; i < num_leaves; ++i) {
+    leaves.emplace_back(static_cast<float>(i));
+  }
+  std::vector<ad::Variable> level = leaves;
+  while (level.size() > 1) {
+    std::vector<ad::Variable> next;
+    for (std::size_t i = 0; i + 1 < level.size(); i += 2) {
+      next.push_back((level[i] + level[i + 1]).Sin());
+    }
+    if (level.size() % 2 == 1) {
+      next.push_back(level.back());
+    }
+    level.swap(next);
+  }
+  auto root = level.front();
+
+  double full_time = 0.0;
+  double incremental_time = 0.0;
+  for (int run = 0; run < num_runs; ++run) {
+    // 修改所有叶子会使整个图变为dirty，相当于完整的前向计算
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto& leaf : leaves) {
+      leaf.SetValue(leaf.Value() + 1.0F);
+    }
+    root.Value();
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> diff = end - start;
+    full_time += diff.count();
+
+    start = std::chrono::high_resolution_clock::now();
+    auto& leaf = leaves[static_cast<std::size_t>(run) % num_leaves];
+    leaf.SetValue(leaf.Value() + 1.0F);
+    root.Value();
+    end = std::chrono::high_resolution_clock::now();
+    diff = end - start;
+    incremental_time += diff.count();
+  }
+  std::cout << "leaves=" << num_leaves
+            << " full forward: " << full_time / num_runs
+            << " ms, single leaf update: " << incremental_time / num_runs
+            << " ms" << std::endl;
+}
+
+// 用值模式的反向传播计算梯度
+std::vector<float> Gradient(const ad::Objective& f,
+                            const std::vector<float>& x) {
+  std::vector<ad::Variable> leaves;
+  for (float value : x) {
+    leaves.emplace_back(value);
+  }
+  f(leaves).Backpropagation(ad::GradMode::kValue);
+  std::vector<float> gradient;
+  for (const auto& leaf : leaves) {
+    gradient.push_back(leaf.GetAdjointValue());
+  }
+  return gradient;
+}
+
+// 比较forward-over-reverse与中心差分
+// (grad(x + eps * v) - grad(x - eps * v)) / 2eps
+// 计算Hessian与向量乘积的耗时和误差，误差以double精度的解析解为基准
+void BenchmarkHvp(std::size_t n, int num_runs) {
+  std::vector<float> x;
+  std::vector<float> v;
+  for (std::size_t i = 0; i < n; ++i) {
+    x.push_back(std::sin(0.1F * static_cast<float>(i)));
+    v.push_back(std::cos(0.3F * static_cast<float>(i)));
+  }
+  const std::vector<double> expected = ad::RosenbrockHvp(x, v);
+  auto max_error = [&expected](const std::vector<float>& hv) {
+    double error = 0.0;
+    for (std::size_t i = 0; i < hv.size(); ++i) {
+      error = std::max(error, std::abs(hv[i] - expected[i]));
+    }
+    return error;
+  };
+
+  ad::Variable::ClearAllVirablesInPool();
+  std::vector<float> hv;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int run = 0; run < num_runs; ++run) {
+    hv = ad::Hvp(ad::Rosenbrock, x, v);
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> hvp_time = end - start;
+  const double hvp_error = max_error(hv);
+
+  std::cout << "hvp n=" << n << " forward-over-reverse: "
+            << hvp_time.count() / num_runs << " ms, max error " << hvp_error;
+  for (float eps : {1e-2F, 1e-3F}) {
+    std::vector<float> fd(n);
+    start = std::chrono::high_resolution_clock::now();
+    for (int run = 0; run < num_runs; ++run) {
+      std::vector<float> x_plus = x;
+      std::vector<float> x_minus = x;
+      for (std::size_t i = 0; i < n; ++i) {
+        x_plus[i] += eps * v[i];
+        x_minus[i] -= eps * v[i];
+      }
+      const auto g_plus = Gradient(ad::Rosenbrock, x_plus);
+      const auto g_minus = Gradient(ad::Rosenbrock, x_minus);
+      for (std::size_t i = 0; i < n; ++i) {
+        fd[i] = (g_plus[i] - g_minus[i]) / (2 * eps);
+      }
+    }
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> fd_time = end - start;
+    std::cout << "; finite difference eps=" << eps << ": "
+              << fd_time.count() / num_runs << " ms, max error "
+              << max_error(fd);
+  }
+  std::cout << std::endl;
+}
+
+// 完整的Hessian，与逐个输入做中心差分比较
+void BenchmarkHessian(std::size_t n) {
+  std::vector<float> x;
+  for (std::size_t i = 0; i < n; ++i) {
+    x.push_back(std::sin(0.1F * static_cast<float>(i)));
+  }
+  ad::Variable::ClearAllVirablesInPool();
+  auto start = std::chrono::high_resolution_clock::now();
+  const auto h = ad::Hessian(ad::Rosenbrock, x);
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> hessian_time = end - start;
+
+  constexpr float eps = 1e-3F;
+  start = std::chrono::high_resolution_clock::now();
+  for (std::size_t j = 0; j < n; ++j) {
+    std::vector<float> x_plus = x;
+    std::vector<float> x_minus = x;
+    x_plus[j] += eps;
+    x_minus[j] -= eps;
+    Gradient(ad::Rosenbrock, x_plus);
+    Gradient(ad::Rosenbrock, x_minus);
+  }
+  end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> fd_time = end - start;
+  std::cout << "hessian n=" << n << " forward-over-reverse: "
+            << hessian_time.count() << " ms, finite difference: "
+            << fd_time.count() << " ms" << std::endl;
+}
+
+// 全连接层sum(x * W)，比较逐元素建图的标量Variable与矩阵Variable的
+// 结点数和建图加反向传播的耗时
+void BenchmarkDenseLayer(int n, int num_runs) {
+  double scalar_time = 0.0;
+  double matrix_time = 0.0;
+  std::size_t scalar_nodes = 0;
+  std::size_t matrix_nodes = 0;
+  for (int run = 0; run < num_runs; ++run) {
+    ad::Variable::ClearAllVirablesInPool();
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<ad::Variable> x;
+    std::vector<ad::Variable> w;
+    for (int i = 0; i < n; ++i) {
+      x.emplace_back(0.01F * static_cast<float>(i));
+    }
+    for (int i = 0; i < n * n; ++i) {
+      w.emplace_back(0.001F * static_cast<float>(i % 97));
+    }
+    auto sum = x[0] * w[0];
+    for (int j = 0; j < n; ++j) {
+      for (int i = j == 0 ? 1 : 0; i < n; ++i) {
+        sum = sum + x[i] * w[i * n + j];
+      }
+    }
+    sum.Backpropagation(ad::GradMode::kValue);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> diff = end - start;
+    scalar_time += diff.count();
+    scalar_nodes = ad::VariableImpl::tape_.Size();
+
+    ad::MatrixVariable::ClearAllVirablesInPool();
+    start = std::chrono::high_resolution_clock::now();
+    Matrix<float> x_value(1, n);
+    Matrix<float> w_value(n, n);
+    for (int i = 0; i < n; ++i) {
+      x_value.Data()[i] = 0.01F * static_cast<float>(i);
+    }
+    for (int i = 0; i < n * n; ++i) {
+      w_value.Data()[i] = 0.001F * static_cast<float>(i % 97);
+    }
+    auto matrix_sum = ad::MatrixVariable{std::move(x_value)}
+                          .MatMul(ad::MatrixVariable{std::move(w_value)})
+                          .Sum();
+    matrix_sum.Backpropagation();
+    end = std::chrono::high_resolution_clock::now();
+    diff = end - start;
+    matrix_time += diff.count();
+    matrix_nodes = ad::MatrixVariableImpl::tape_.Size();
+  }
+  std::cout << "dense n=" << n << " scalar: " << scalar_nodes << " nodes, "
+            << scalar_time / num_runs << " ms; matrix: " << matrix_nodes
+            << " nodes, " << matrix_time / num_runs << " ms" << std::endl;
+}
+
+// 符号模式得到的梯度计算图化简前后的指令数，以及修改输入后重新求值的耗时
+void BenchmarkSimplify(std::size_t num_layers, int num_runs) {
+  ad::Variable::ClearAllVirablesInPool();
+  auto w = ad::Variable{0.9F};
+  auto x = ad::Variable{0.5F};
+  auto h = x;
+  for (std::size_t i = 0; i < num_layers; ++i) {
+    h = (h * w).Sin() / (h.Exp() + w) + h;
+  }
+  h.Backpropagation();
+  auto gradient = x.GetAdjoint();
+  auto simplified = ad::Variable::Simplify({gradient}).front();
+
+  auto evaluate = [&x, num_runs](ad::Variable& root) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int run = 0; run < num_runs; ++run) {
+      x.SetValue(0.5F + 0.01F * static_cast<float>(run));
+      root.Value();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> diff = end - start;
+    return diff.count() / num_runs;
+  };
+  const double gradient_time = evaluate(gradient);
+  const double simplified_time = evaluate(simplified);
+  std::cout << "layers=" << num_layers << " gradient instructions: "
+            << gradient.Compile().NumInstructions() << " -> "
+            << simplified.Compile().NumInstructions()
+            << ", evaluate: " << gradient_time << " ms -> "
+            << simplified_time << " ms" << std::endl;
+}
+
+// 比较通过运算符重新建图并编译与加载保存的编译结果的耗时
+void BenchmarkLoad(std::size_t num_nodes) {
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "autodiff_benchmark.bin")
+          .string();
+  ad::Variable::ClearAllVirablesInPool();
+  auto start = std::chrono::high_resolution_clock::now();
+  auto graph = BuildDiamond(num_nodes).Compile();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> build_time = end - start;
+  graph.Save(path);
+
+  start = std::chrono::high_resolution_clock::now();
+  auto loaded = ad::CompiledGraph::Load(path);
+  end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> load_time = end - start;
+  std::filesystem::remove(path);
+  std::cout << "instructions=" << loaded.NumInstructions()
+            << " build+compile: " << build_time.count()
+            << " ms, load: " << load_time.count() << " ms" << std::endl;
+}
+
+// 不清空变量池的训练循环，临时结点在每一步结束时被回收，
+// Tape中的结点数不随步数增长
+void BenchmarkTraining(int num_steps) {
+  ad::Variable::ClearAllVirablesInPool();
+  auto w = ad::Variable{0.5F};
+  auto b = ad::Variable{0.1F};
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int step = 0; step < num_steps; ++step) {
+    auto x = ad::Variable{0.001F * static_cast<float>(step % 1000)};
+    auto y = (w * x + b).Sin() * (-x).Exp();
+    y.Backpropagation(ad::GradMode::kValue);
+    w.SetValue(w.Value() - 0.01F * w.GetAdjointValue());
+    b.SetValue(b.Value() - 0.01F * b.GetAdjointValue());
+    ad::Variable::ZeroGradient();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> diff = end - start;
+  std::cout << "training steps=" << num_steps << ": "
+            << diff.count() * 1e6 / num_steps << " ns/step, tape size "
+            << ad::VariableImpl::tape_.Size() << ", live nodes "
+            << ad::VariableImpl::tape_.NumLive() << std::endl;
+}
+
+int main() {
+  const std::vector<std::pair<std::string,
+                              std::function<ad::Variable(std::size_t)>>>
+      graphs = {{"chain", BuildChain},
+                {"tree", BuildTree},
+                {"diamond", BuildDiamond}};
+  const std::vector<std::size_t> sizes = {1 << 10, 1 << 12, 1 << 14, 1 << 16,
+                                          1 << 18};
+  constexpr int num_runs = 5;
+
+  const std::vector<std::pair<std::string, ad::GradMode>> modes = {
+      {"symbolic", ad::GradMode::kSymbolic}, {"value", ad::GradMode::kValue}};
+
+  for (const auto& [name, build] : graphs) {
+    for (const auto& [mode_name, mode] : modes) {
+      for (auto num_nodes : sizes) {
+        double total_time = 0.0;
+        std::size_t graph_size = 0;
+        for (int i = 0; i < num_runs; ++i) {
+          ad::Variable::ClearAllVirablesInPool();
+          auto root = build(num_nodes);
+          graph_size = ad::VariableImpl::tape_.Size();
+          auto start = std::chrono::high_resolution_clock::now();
+          root.Backpropagation(mode);
+          auto end = std::chrono::high_resolution_clock::now();
+          std::chrono::duration<double, std::milli> diff = end - start;
+          total_time += diff.count();
+        }
+        double avg_time = total_time / num_runs;
+        std::cout << name << " nodes=" << graph_size << " " << mode_name
+                  << " backprop: " << avg_time << " ms, "
+                  << avg_time * 1e6 / static_cast<double>(graph_size)
+                  << " ns/node" << std::endl;
+      }
+    }
+    // 编译一次，之后每次修改叶子值重新做前向和反向传播，不计入编译时间
+    for (auto num_nodes : sizes) {
+      ad::Variable::ClearAllVirablesInPool();
+      auto graph = build(num_nodes).Compile();
+      const std::size_t graph_size = ad::VariableImpl::tape_.Size();
+      auto start = std::chrono::high_resolution_clock::now();
+      for (int i = 0; i < num_runs; ++i) {
+        graph.SetLeafValue(0, graph.LeafValue(0) * 1.0001F);
+        graph.Forward();
+        graph.Backward();
+      }
+      auto end = std::chrono::high_resolution_clock::now();
+      std::chrono::duration<double, std::milli> diff = end - start;
+      double avg_time = diff.count() / num_runs;
+      std::cout << name << " nodes=" << graph_size
+                << " compiled forward+backward: " << avg_time << " ms, "
+                << avg_time * 1e6 / static_cast<double>(graph_size)
+                << " ns/node" << std::endl;
+    }
+  }
+  for (std::size_t batch_size : {1 << 10, 1 << 14, 1 << 18}) {
+    BenchmarkBatch(batch_size, num_runs);
+  }
+  for (std::size_t num_nodes : {1 << 10, 1 << 14, 1 << 18}) {
+    BenchmarkConstruction(num_nodes, num_runs);
+  }
+  const std::size_t max_threads =
+      std::max(1U, std::thread::hardware_concurrency());
+  for (std::size_t num_threads = 1; num_threads <= max_threads;
+       num_threads *= 2) {
+    BenchmarkThreads(num_threads, 4096);
+  }
+  BenchmarkParallelBackward(max_threads, num_runs);
+  for (std::size_t num_outputs : {1 << 8, 1 << 12, 1 << 16}) {
+    BenchmarkJacobian(num_outputs, num_runs);
+  }
+  BenchmarkCheckpoint(1024, 4096);
+  for (std::size_t num_leaves : {1 << 10, 1 << 14, 1 << 18}) {
+    BenchmarkIncremental(num_leaves, num_runs);
+  }
+  for (std::size_t n : {100, 10000}) {
+    BenchmarkHvp(n, num_runs);
+  }
+  for (std::size_t n : {64, 512}) {
+    BenchmarkHessian(n);
+  }
+  for (int n : {16, 64, 256}) {
+    BenchmarkDenseLayer(n, num_runs);
+  }
+  for (std::size_t num_layers : {1 << 6, 1 << 10, 1 << 14}) {
+    BenchmarkSimplify(num_layers, num_runs);
+  }
+  for (std::size_t num_nodes : {1 << 14, 1 << 18, 1 << 22}) {
+    BenchmarkLoad(num_nodes);
+  }
+  for (int num_steps : {1000, 1000000}) {
+    BenchmarkTraining(num_steps);
+  }
+  ad::Variable::ClearAllVirablesInPool();
+  ad::BatchVariable::ClearAllVirablesInPool();
+  return 0;
+}
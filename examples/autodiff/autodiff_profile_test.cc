@@ -0,0 +1,64 @@
+// 在定义AD_PROFILE的情况下编译，其余测试都在autodiff_test.cc中
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+
+#include "autodiff.h"
+#include "batch_variable.h"
+
+TEST(Profiler, CountsNodesAndCalls) {
+  auto& profiler = ad::Profiler::Get();
+  ad::Variable::ClearAllVirablesInPool();
+  profiler.Reset();
+  auto w = ad::Variable{0.5F};
+  auto x = ad::Variable{2.0F};
+  auto y = (w * x).Sin() * x + w;
+  y.Backpropagation(ad::GradMode::kValue);
+
+  const auto& stats = profiler.Stats();
+  const auto& mul = stats[static_cast<std::size_t>(ad::OpCode::kMul)];
+  const auto& sin = stats[static_cast<std::size_t>(ad::OpCode::kSin)];
+  const auto& div = stats[static_cast<std::size_t>(ad::OpCode::kDiv)];
+  EXPECT_EQ("mul", mul.name);
+  EXPECT_EQ(2U, mul.num_nodes);
+  EXPECT_EQ(2U, mul.num_forward);
+  EXPECT_EQ(2U, mul.num_gradient);
+  EXPECT_EQ(1U, sin.num_nodes);
+  EXPECT_EQ(1U, sin.num_gradient);
+  EXPECT_TRUE(div.name.empty());
+  EXPECT_EQ(0U, div.num_nodes);
+
+  // 符号模式的梯度计算图也会创建结点：两个乘法的梯度各创建2个乘法，
+  // sin的梯度创建cos和一个乘法
+  ad::Variable::ZeroGradient();
+  y.Backpropagation(ad::GradMode::kSymbolic);
+  EXPECT_EQ(2U, sin.num_gradient);
+  EXPECT_EQ(4U, mul.num_gradient);
+  EXPECT_EQ(7U, mul.num_nodes);
+  EXPECT_EQ(1U, stats[static_cast<std::size_t>(ad::OpCode::kCos)].num_nodes);
+
+  // BatchVariable与Variable共享op，统计合并在一起
+  auto batch = ad::BatchVariable{{1.0F, 2.0F}};
+  (batch * batch).Backpropagation();
+  EXPECT_EQ(8U, mul.num_nodes);
+  EXPECT_EQ(3U, mul.num_forward);
+  EXPECT_EQ(5U, mul.num_gradient);
+
+  const std::string report = profiler.Report();
+  EXPECT_EQ(0U, report.find("op"));
+  EXPECT_NE(std::string::npos, report.find("sin"));
+  EXPECT_NE(std::string::npos, report.find("plus"));
+
+  std::ostringstream trace;
+  profiler.WriteChromeTrace(trace);
+  EXPECT_EQ(0U, trace.str().find("{\"traceEvents\":["));
+  EXPECT_NE(std::string::npos, trace.str().find("\"cat\":\"gradient\""));
+  EXPECT_NE(std::string::npos,
+            trace.str().find("\"name\":\"Backpropagation\""));
+
+  profiler.Reset();
+  EXPECT_EQ(0U, profiler.Stats()[0].num_nodes);
+  ad::Variable::ClearAllVirablesInPool();
+  ad::BatchVariable::ClearAllVirablesInPool();
+}
@@ -1,7 +1,20 @@
 #include "autodiff.h"
 
+#include "batch_variable.h"
+#include "compiled_graph.h"
+#include "dual.h"
+#include "hessian.h"
+#include "matrix_variable.h"
+#include "rosenbrock.h"
+#include "simd_math.h"
+
 #include <gtest/gtest.h>
 
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+
 TEST(AutoDiff, UnaryOperators) {
   auto v0 = ad::Variable{2};
   auto v1 = v0.Sin();
@@ -71,4 +84,668 @@ TEST(AutoDiff, GetTopoGraph) {
 TEST(AutoDiff, GetEmptyAdjoint) {
   auto v = ad::Variable{2};
   EXPECT_ANY_THROW(v.GetAdjoint());
-}
\ No newline at end of file
+}
+
+TEST(AutoDiff, SharedOpInstances) {
+  ad::Variable::ClearAllVirablesInPool();
+  auto x = ad::Variable{1};
+  auto y = ad::Variable{2};
+  auto a = x + y;
+  auto b = a + x;
+  EXPECT_EQ(a.Op(), b.Op());
+  EXPECT_NE(a.Op(), (a * b).Op());
+  EXPECT_EQ(nullptr, x.Op());
+  EXPECT_EQ("plus", b.Op()->GetName());
+}
+
+TEST(AutoDiff, TapeReset) {
+  ad::Variable::ClearAllVirablesInPool();
+  auto v0 = ad::Variable{2};
+  auto v1 = (v0 * v0).Exp();
+  EXPECT_EQ("v2", v1.Name());
+  EXPECT_EQ(3U, ad::VariableImpl::tape_.Size());
+
+  ad::Variable::ClearAllVirablesInPool();
+  EXPECT_EQ(0U, ad::VariableImpl::tape_.Size());
+  auto v2 = ad::Variable{3};
+  EXPECT_EQ("v0", v2.Name());
+  EXPECT_EQ(0U, v2.NumInputs());
+  EXPECT_FLOAT_EQ(3, v2.Value());
+}
+
+TEST(AutoDiff, NodesReclaimedWithoutReset) {
+  ad::Variable::ClearAllVirablesInPool();
+  auto w = ad::Variable{0.5F};
+  auto b = ad::Variable{0.1F};
+  const std::size_t num_params = ad::VariableImpl::tape_.NumLive();
+  for (int step = 0; step < 1000; ++step) {
+    auto x = ad::Variable{0.001F * static_cast<float>(step)};
+    auto y = (w * x + b).Sin() * (-x).Exp();
+    for (int i = 0; i < 16; ++i) {
+      y = y * y.Cos() + x;
+    }
+    y.Backpropagation(step % 2 == 0 ? ad::GradMode::kValue
+                                    : ad::GradMode::kSymbolic);
+    w.SetValue(w.Value() - 0.01F * w.GetAdjointValue());
+    ad::Variable::ZeroGradient();
+  }
+  // 符号模式留下的伴随值被固定为常数，w和b各有一个
+  EXPECT_EQ(num_params + 2, ad::VariableImpl::tape_.NumLive());
+  EXPECT_LT(ad::VariableImpl::tape_.Size(), 1000U);
+
+  // 长链上的回收是迭代进行的，不会因为递归过深而栈溢出
+  {
+    auto x = w;
+    for (int i = 0; i < 1000000; ++i) {
+      x = x + b;
+    }
+  }
+  EXPECT_EQ(num_params + 2, ad::VariableImpl::tape_.NumLive());
+}
+
+TEST(AutoDiff, TapeAcrossChunks) {
+  ad::Variable::ClearAllVirablesInPool();
+  auto one = ad::Variable{1};
+  auto sum = one;
+  for (std::size_t i = 0; i < ad::Tape::kChunkSize; ++i) {
+    sum = sum + one;
+  }
+  EXPECT_FLOAT_EQ(ad::Tape::kChunkSize + 1, sum.Value());
+  EXPECT_EQ(ad::Tape::kChunkSize + 1, ad::VariableImpl::tape_.Size());
+}
+
+TEST(AutoDiff, TopoSortSharedSubexpressions) {
+  ad::Variable::ClearAllVirablesInPool();
+  // 深度为64的菱形结构，每层4条边，如果按路径遍历，将有2^64条路径
+  auto x = ad::Variable{0.5F};
+  auto y = x;
+  for (int i = 0; i < 64; ++i) {
+    y = y * y + y;
+  }
+  auto graph = y.GetTopoGraph();
+  EXPECT_EQ(64 * 4, std::count(graph.begin(), graph.end(), '\n'));
+
+  ad::Variable::ClearAllVirablesInPool();
+  x = ad::Variable{0.5F};
+  y = x;
+  for (int i = 0; i < 6; ++i) {
+    y = y * y + y;
+  }
+  y.Backpropagation();
+  // y = x^2 + x 迭代6次，按链式法则逐层计算导数
+  float value = 0.5F;
+  float grad = 1.0F;
+  for (int i = 0; i < 6; ++i) {
+    grad *= 2 * value + 1;
+    value = value * value + value;
+  }
+  EXPECT_NEAR(grad, x.GetAdjoint().Value(), grad * 1e-5);
+}
+
+TEST(AutoDiff, ValueModeMatchesSymbolicMode) {
+  ad::Variable::ClearAllVirablesInPool();
+  auto v0 = ad::Variable{2};
+  auto v1 = ad::Variable{5};
+  auto v = (v0.Log() + v0 * v1 - v1.Sin()) / v0.Exp() + (-v1).Cos();
+
+  const std::size_t num_nodes = ad::VariableImpl::tape_.Size();
+  v.Backpropagation(ad::GradMode::kValue);
+  // 值模式的反向传播不会在Tape上创建新的结点
+  EXPECT_EQ(num_nodes, ad::VariableImpl::tape_.Size());
+
+  v.Backpropagation();
+  EXPECT_FLOAT_EQ(v0.GetAdjoint().Value(), v0.GetAdjointValue());
+  EXPECT_FLOAT_EQ(v1.GetAdjoint().Value(), v1.GetAdjointValue());
+}
+
+TEST(AutoDiff, ValueModeMultiPath) {
+  ad::Variable::ClearAllVirablesInPool();
+  auto v0 = ad::Variable{2};
+  auto v1 = ad::Variable{5};
+
+  auto v2 = v0.Log() * v1;
+  auto v3 = v0.Sin() - v1;
+
+  v2.Backpropagation(ad::GradMode::kValue);
+  v3.Backpropagation(ad::GradMode::kValue);
+  EXPECT_FLOAT_EQ(5.0F / 2 + std::cos(2), v0.GetAdjointValue());
+  EXPECT_FLOAT_EQ(std::log(2) - 1, v1.GetAdjointValue());
+
+  ad::Variable::ZeroGradient();
+  v3.Backpropagation(ad::GradMode::kValue);
+  EXPECT_FLOAT_EQ(std::cos(2), v0.GetAdjointValue());
+  EXPECT_FLOAT_EQ(-1, v1.GetAdjointValue());
+}
+
+TEST(AutoDiff, SetValueReevaluatesDownstream) {
+  ad::Variable::ClearAllVirablesInPool();
+  auto v0 = ad::Variable{2};
+  auto v1 = ad::Variable{5};
+  auto v2 = v0 * v1 + v0.Sin();
+  auto v3 = v1.Exp();
+  EXPECT_FLOAT_EQ(10 + std::sin(2), v2.Value());
+  EXPECT_FLOAT_EQ(std::exp(5), v3.Value());
+
+  v0.SetValue(3);
+  EXPECT_FLOAT_EQ(3, v0.Value());
+  EXPECT_FLOAT_EQ(15 + std::sin(3), v2.Value());
+  EXPECT_FLOAT_EQ(std::exp(5), v3.Value());
+
+  // 修改后再创建的结点和已有结点共享同一个输入
+  v1.SetValue(1);
+  auto v4 = v2 * v3;
+  EXPECT_FLOAT_EQ((3 + std::sin(3)) * std::exp(1), v4.Value());
+  EXPECT_FLOAT_EQ(3 + std::sin(3), v2.Value());
+
+  v4.Backpropagation(ad::GradMode::kValue);
+  EXPECT_NEAR((1 + std::cos(3)) * std::exp(1), v0.GetAdjointValue(), 1e-6);
+
+  EXPECT_THROW(v2.SetValue(1), std::invalid_argument);
+}
+
+TEST(AutoDiff, SimplifyIdentities) {
+  ad::Variable::ClearAllVirablesInPool();
+  auto x = ad::Variable{2};
+  auto zero = ad::Variable::Constant(0);
+  auto one = ad::Variable::Constant(1);
+  auto simplified = ad::Variable::Simplify(
+      {x * one, zero + x, x - zero, x / one, -(-x), zero - x,
+       ad::Variable::Constant(2) * ad::Variable::Constant(3).Exp(),
+       x.Exp() * (x + one).Sin() + (one + x).Sin() * x.Exp()});
+  for (std::size_t i = 0; i < 5; ++i) {
+    EXPECT_TRUE(simplified[i] == x);
+  }
+  EXPECT_EQ(ad::GetOp<ad::Negitive>("neg"), simplified[5].Op());
+  EXPECT_TRUE(simplified[5].Inputs(0) == x);
+  EXPECT_TRUE(simplified[6].IsConstant());
+  EXPECT_FLOAT_EQ(2 * std::exp(3.0F), simplified[6].Value());
+  // 两个乘积的输入在交换顺序后完全相同，化简后合并为同一个结点
+  EXPECT_TRUE(simplified[7].Inputs(0) == simplified[7].Inputs(1));
+  EXPECT_THROW(one.SetValue(2), std::invalid_argument);
+}
+
+TEST(AutoDiff, SimplifyGradientGraph) {
+  ad::Variable::ClearAllVirablesInPool();
+  auto w = ad::Variable{1.3F};
+  auto x = ad::Variable{0.7F};
+  auto y = (w * x).Exp() / (x + w) - (w * x).Sin();
+  y.Backpropagation();
+  const std::vector<ad::Variable> gradients = {w.GetAdjoint(), x.GetAdjoint()};
+  const auto simplified = ad::Variable::Simplify(gradients);
+  for (std::size_t i = 0; i < gradients.size(); ++i) {
+    EXPECT_LT(simplified[i].Compile().NumInstructions(),
+              gradients[i].Compile().NumInstructions());
+  }
+  // 化简不会折叠非常量的叶子，修改叶子之后结果仍然一致
+  for (float x_value : {0.7F, -1.5F}) {
+    x.SetValue(x_value);
+    for (std::size_t i = 0; i < gradients.size(); ++i) {
+      auto expected = gradients[i];
+      auto actual = simplified[i];
+      EXPECT_FLOAT_EQ(expected.Value(), actual.Value());
+    }
+  }
+}
+
+TEST(AutoDiff, CompiledGraphMatchesValueMode) {
+  ad::Variable::ClearAllVirablesInPool();
+  auto w = ad::Variable{0.3F};
+  auto b = ad::Variable{1.0F};
+  auto x = ad::Variable{0.5F};
+  auto h = (w * x + b).Sin() * (-x).Exp() / (x * x + w.Cos());
+  auto y = h.Log() - h * h;
+  auto graph = y.Compile();
+  EXPECT_EQ(3U, graph.NumLeaves());
+  const std::size_t w_index = graph.LeafIndex(w);
+  const std::size_t x_index = graph.LeafIndex(x);
+  EXPECT_THROW(graph.LeafIndex(h), std::invalid_argument);
+
+  // 同一个编译结果对不同的叶子值反复求值和求梯度
+  for (float x_value : {0.5F, 1.0F, 2.0F}) {
+    x.SetValue(x_value);
+    graph.SetLeafValue(x_index, x_value);
+    ad::Variable::ZeroGradient();
+    y.Backpropagation(ad::GradMode::kValue);
+    EXPECT_FLOAT_EQ(y.Value(), graph.Forward());
+    graph.Backward();
+    EXPECT_FLOAT_EQ(w.GetAdjointValue(), graph.LeafAdjoint(w_index));
+    EXPECT_FLOAT_EQ(x.GetAdjointValue(), graph.LeafAdjoint(x_index));
+  }
+}
+
+TEST(AutoDiff, CompileLeafRoot) {
+  ad::Variable::ClearAllVirablesInPool();
+  auto x = ad::Variable{2};
+  auto graph = x.Compile();
+  EXPECT_EQ(0U, graph.NumInstructions());
+  graph.SetLeafValue(0, 3);
+  EXPECT_FLOAT_EQ(3, graph.Forward());
+  graph.Backward();
+  EXPECT_FLOAT_EQ(1, graph.LeafAdjoint(0));
+}
+
+TEST(AutoDiff, SaveAndLoadCompiledGraph) {
+  ad::Variable::ClearAllVirablesInPool();
+  auto w = ad::Variable{0.3F};
+  auto x = ad::Variable{0.5F};
+  auto b = ad::Variable{1.0F};
+  auto y = ((w * x + b).Sin() / (x * x + w.Cos())).Exp() - x;
+  auto graph = y.Compile();
+  const std::size_t x_index = graph.LeafIndex(x);
+  const std::string path = testing::TempDir() + "autodiff_graph.bin";
+  graph.Save(path);
+
+  // 加载的计算图不依赖Tape，清空之后仍然可以使用
+  ad::Variable::ClearAllVirablesInPool();
+  auto loaded = ad::CompiledGraph::Load(path);
+  EXPECT_EQ(graph.NumLeaves(), loaded.NumLeaves());
+  EXPECT_EQ(graph.NumInstructions(), loaded.NumInstructions());
+  EXPECT_TRUE(loaded.Leaves().empty());
+  EXPECT_FLOAT_EQ(graph.Value(), loaded.Forward());
+  for (float x_value : {0.5F, 2.0F}) {
+    graph.SetLeafValue(x_index, x_value);
+    loaded.SetLeafValue(x_index, x_value);
+    EXPECT_FLOAT_EQ(graph.Forward(), loaded.Forward());
+    graph.Backward();
+    loaded.Backward();
+    for (std::size_t i = 0; i < graph.NumLeaves(); ++i) {
+      EXPECT_FLOAT_EQ(graph.LeafAdjoint(i), loaded.LeafAdjoint(i));
+    }
+  }
+
+  // 截断的文件和不存在的文件
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write("ADGR", 4);
+  }
+  EXPECT_THROW(ad::CompiledGraph::Load(path), std::runtime_error);
+  std::remove(path.c_str());
+  EXPECT_THROW(ad::CompiledGraph::Load(path), std::runtime_error);
+}
+
+// 每个线程在自己的Tape上反复建图、求导并清空，检查结果没有受到其他线程的干扰
+TEST(AutoDiff, PerThreadTapes) {
+  constexpr int num_threads = 8;
+  constexpr int num_iterations = 200;
+  std::vector<int> num_errors(num_threads, 0);
+  auto worker = [&num_errors](int id) {
+    for (int i = 0; i < num_iterations; ++i) {
+      ad::Variable::ClearAllVirablesInPool();
+      const float x_value = static_cast<float>(id) + 0.01F * i;
+      auto x = ad::Variable{x_value};
+      auto y = ad::Variable{2};
+      auto z = x * x * y + x.Sin();
+      for (int j = 0; j < 16; ++j) {
+        z = z + x * y;
+      }
+      z.Backpropagation(ad::GradMode::kValue);
+      const float expected = 4 * x_value + std::cos(x_value) + 32;
+      if (std::abs(x.GetAdjointValue() - expected) > 1e-4F * expected) {
+        ++num_errors[id];
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int id = 0; id < num_threads; ++id) {
+    threads.emplace_back(worker, id);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  for (int id = 0; id < num_threads; ++id) {
+    EXPECT_EQ(0, num_errors[id]) << "thread " << id;
+  }
+}
+
+TEST(AutoDiff, ParallelBackpropagation) {
+  ad::ThreadPool pool(4);
+  ad::Variable::ClearAllVirablesInPool();
+  // 宽而浅的计算图：每层都有足够多的结点触发并行执行，叶子之间共享使用者
+  std::vector<ad::Variable> leaves;
+  for (int i = 0; i < 1024; ++i) {
+    leaves.emplace_back(0.001F * static_cast<float>(i));
+  }
+  std::vector<ad::Variable> level;
+  for (std::size_t i = 0; i < leaves.size(); ++i) {
+    const auto& next = leaves[(i + 1) % leaves.size()];
+    level.push_back((leaves[i] * next).Sin() + leaves[i].Exp());
+  }
+  while (level.size() > 1) {
+    std::vector<ad::Variable> next;
+    for (std::size_t i = 0; i + 1 < level.size(); i += 2) {
+      next.push_back((level[i] * level[i + 1]).Sin() + level[i + 1]);
+    }
+    level.swap(next);
+  }
+  auto root = level.front() / leaves.front().Cos();
+
+  root.Backpropagation(ad::GradMode::kValue);
+  std::vector<float> expected;
+  for (const auto& leaf : leaves) {
+    expected.push_back(leaf.GetAdjointValue());
+  }
+  const float expected_root = root.Value();
+
+  ad::Variable::ZeroGradient();
+  leaves[3].SetValue(leaves[3].Value());
+  root.Backpropagation(pool);
+  EXPECT_FLOAT_EQ(expected_root, root.Value());
+  for (std::size_t i = 0; i < leaves.size(); ++i) {
+    EXPECT_NEAR(expected[i], leaves[i].GetAdjointValue(),
+                1e-5F * std::abs(expected[i]) + 1e-6F);
+  }
+}
+
+namespace {
+Matrix<float> MakeMatrix(int rows, int cols, float scale) {
+  Matrix<float> m(rows, cols);
+  for (int i = 0; i < rows * cols; ++i) {
+    m.Data()[i] = scale * std::sin(1.0F + 0.7F * static_cast<float>(i));
+  }
+  return m;
+}
+
+// loss = sum(softmax(relu(x * w1 + b1) * w2) * v)，leaves依次为x、w1、b1、w2、v
+ad::MatrixVariable BuildMlpLoss(const std::vector<Matrix<float>>& params,
+                                std::vector<ad::MatrixVariable>* leaves) {
+  leaves->clear();
+  for (const auto& param : params) {
+    leaves->emplace_back(param);
+  }
+  const auto& l = *leaves;
+  auto hidden = (l[0].MatMul(l[1]) + l[2]).ReLU();
+  return hidden.MatMul(l[3]).Softmax().MatMul(l[4]).Sum();
+}
+}  // namespace
+
+TEST(AutoDiff, MatrixMatchesFiniteDifference) {
+  ad::MatrixVariable::ClearAllVirablesInPool();
+  std::vector<Matrix<float>> params = {
+      MakeMatrix(4, 3, 1.0F), MakeMatrix(3, 5, 0.5F), MakeMatrix(1, 5, 0.1F),
+      MakeMatrix(5, 3, 0.7F), MakeMatrix(3, 1, 1.0F)};
+  std::vector<ad::MatrixVariable> leaves;
+  auto loss = BuildMlpLoss(params, &leaves);
+  loss.Backpropagation();
+  // 5个叶子和7个op结点，与矩阵的大小无关
+  EXPECT_EQ(12U, ad::MatrixVariableImpl::tape_.Size());
+
+  std::vector<ad::MatrixVariable> perturbed;
+  constexpr float eps = 1e-2F;
+  for (std::size_t p = 0; p < params.size(); ++p) {
+    for (int i = 0; i < params[p].Rows() * params[p].Cols(); ++i) {
+      float& value = params[p].Data()[i];
+      const float original = value;
+      value = original + eps;
+      const float loss_plus =
+          BuildMlpLoss(params, &perturbed).Value().At(0, 0);
+      value = original - eps;
+      const float loss_minus =
+          BuildMlpLoss(params, &perturbed).Value().At(0, 0);
+      value = original;
+      EXPECT_NEAR((loss_plus - loss_minus) / (2 * eps),
+                  leaves[p].GetAdjoint().Data()[i], 2e-3);
+    }
+  }
+}
+
+TEST(AutoDiff, MatrixShapeMismatch) {
+  ad::MatrixVariable::ClearAllVirablesInPool();
+  auto x = ad::MatrixVariable{MakeMatrix(4, 3, 1.0F)};
+  auto b = ad::MatrixVariable{MakeMatrix(1, 3, 1.0F)};
+  EXPECT_THROW(x.MatMul(x), std::invalid_argument);
+  EXPECT_THROW(b + x, std::invalid_argument);
+  EXPECT_THROW(ad::MatrixVariable{Matrix<float>()}, std::invalid_argument);
+  // 按行广播的偏置，伴随值为各行伴随值之和
+  auto y = x + b;
+  y.Backpropagation();
+  for (int j = 0; j < 3; ++j) {
+    EXPECT_FLOAT_EQ(4, b.GetAdjoint().At(0, j));
+  }
+}
+
+TEST(AutoDiff, HessianVectorProduct) {
+  ad::Variable::ClearAllVirablesInPool();
+  const std::vector<float> x = {0.5F, -0.3F, 1.2F, 0.8F};
+  const std::vector<float> v = {1.0F, 2.0F, -1.0F, 0.5F};
+  const auto expected = ad::RosenbrockHvp(x, v);
+  const auto hv = ad::Hvp(ad::Rosenbrock, x, v);
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    EXPECT_NEAR(expected[i], hv[i], 1e-3 * std::abs(expected[i]) + 1e-3);
+  }
+
+  // 包含sin、exp、log和除法的函数，与解析解比较：
+  // f = sin(x0) * exp(x1) + log(x0) / x1
+  auto f = [](const std::vector<ad::Variable>& x) {
+    return x[0].Sin() * x[1].Exp() + x[0].Log() / x[1];
+  };
+  const float x0 = 0.7F;
+  const float x1 = 1.3F;
+  const float h00 = -std::sin(x0) * std::exp(x1) - 1 / (x0 * x0 * x1);
+  const float h01 = std::cos(x0) * std::exp(x1) - 1 / (x0 * x1 * x1);
+  const float h11 =
+      std::sin(x0) * std::exp(x1) + 2 * std::log(x0) / (x1 * x1 * x1);
+  const auto hv2 = ad::Hvp(f, {x0, x1, 5.0F}, {1.0F, -2.0F, 3.0F});
+  EXPECT_NEAR(h00 - 2 * h01, hv2[0], 1e-4);
+  EXPECT_NEAR(h01 - 2 * h11, hv2[1], 1e-4);
+  // 与root无关的输入
+  EXPECT_FLOAT_EQ(0, hv2[2]);
+  EXPECT_THROW(ad::Hvp(f, {x0, x1}, {1.0F}), std::invalid_argument);
+}
+
+TEST(AutoDiff, FullHessian) {
+  ad::Variable::ClearAllVirablesInPool();
+  // 输入数多于一次遍历的方向数，需要分多次计算
+  std::vector<float> x;
+  for (int i = 0; i < 11; ++i) {
+    x.push_back(0.1F * static_cast<float>(i) - 0.4F);
+  }
+  const auto expected = ad::RosenbrockHessian(x);
+  const auto h = ad::Hessian(ad::Rosenbrock, x);
+  ASSERT_EQ(x.size(), h.size());
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    for (std::size_t j = 0; j < x.size(); ++j) {
+      EXPECT_NEAR(expected[i][j], h[i][j], 1e-3F) << i << ", " << j;
+    }
+  }
+}
+
+TEST(AutoDiff, BatchMatchesScalar) {
+  ad::Variable::ClearAllVirablesInPool();
+  ad::BatchVariable::ClearAllVirablesInPool();
+  const std::vector<float> xs = {0.5F, 1.0F, 2.0F, 3.0F, 4.5F};
+  auto x = ad::BatchVariable{xs};
+  auto w = ad::BatchVariable{{0.3F}};
+  auto b = ad::BatchVariable{{-1.0F}};
+  auto y = (w * x + b).Sin() * (-x).Exp() / x.Log().Cos() - x;
+  y.Backpropagation();
+  ASSERT_EQ(xs.size(), y.BatchSize());
+
+  float w_adjoint = 0;
+  for (std::size_t i = 0; i < xs.size(); ++i) {
+    auto sx = ad::Variable{xs[i]};
+    auto sw = ad::Variable{0.3F};
+    auto sb = ad::Variable{-1.0F};
+    auto sy = (sw * sx + sb).Sin() * (-sx).Exp() / sx.Log().Cos() - sx;
+    sy.Backpropagation(ad::GradMode::kValue);
+    EXPECT_FLOAT_EQ(sy.Value(), y.Value()[i]);
+    EXPECT_FLOAT_EQ(sx.GetAdjointValue(), x.GetAdjoint()[i]);
+    w_adjoint += sw.GetAdjointValue();
+  }
+  ASSERT_EQ(1, w.GetAdjoint().size());
+  EXPECT_FLOAT_EQ(w_adjoint, w.GetAdjoint().front());
+
+  // 叶子结点的伴随值在多次反向传播之间累加
+  auto x_adjoint = x.GetAdjoint();
+  y.Backpropagation();
+  EXPECT_FLOAT_EQ(2 * x_adjoint[0], x.GetAdjoint()[0]);
+  ad::BatchVariable::ZeroGradient();
+  EXPECT_ANY_THROW(x.GetAdjoint());
+}
+
+TEST(AutoDiff, BatchSizeMismatch) {
+  ad::BatchVariable::ClearAllVirablesInPool();
+  auto x = ad::BatchVariable{{1, 2, 3}};
+  auto y = ad::BatchVariable{{1, 2}};
+  EXPECT_ANY_THROW(x + y);
+  EXPECT_ANY_THROW(ad::BatchVariable{std::vector<float>{}});
+}
+
+namespace {
+// 在[lo, hi]上均匀取点，分别用向量版本和标量版本（n=1）计算，
+// 返回与double版本的std函数相比，误差除以max(1, |ref|)后的最大值
+template <typename Fn, typename RefFn>
+double MaxScaledError(Fn fn, RefFn ref, double lo, double hi) {
+  constexpr std::size_t kNumPoints = 100003;
+  std::vector<float> x(kNumPoints);
+  std::vector<float> y(kNumPoints);
+  for (std::size_t i = 0; i < kNumPoints; ++i) {
+    x[i] = static_cast<float>(lo + (hi - lo) * i / (kNumPoints - 1));
+  }
+  fn(x.data(), y.data(), kNumPoints);
+  double max_error = 0;
+  for (std::size_t i = 0; i < kNumPoints; ++i) {
+    float scalar;
+    fn(&x[i], &scalar, 1);
+    double expected = ref(static_cast<double>(x[i]));
+    double scale = std::max(1.0, std::fabs(expected));
+    max_error = std::max(max_error, std::fabs(y[i] - expected) / scale);
+    max_error = std::max(max_error, std::fabs(scalar - expected) / scale);
+  }
+  return max_error;
+}
+}  // namespace
+
+TEST(Dual, MatchesReverseMode) {
+  ad::Variable::ClearAllVirablesInPool();
+  auto f = [](auto x, auto y) {
+    return (x * y + x.Sin()) / (y.Exp() - x.Cos()) + (-x).Log() * y;
+  };
+  auto x = ad::Variable{-0.5F};
+  auto y = ad::Variable{1.5F};
+  auto z = f(x, y);
+  z.Backpropagation(ad::GradMode::kValue);
+
+  using Dual2 = ad::Dual<float, 2>;
+  auto dual_z = f(Dual2::Input(-0.5F, 0), Dual2::Input(1.5F, 1));
+  EXPECT_FLOAT_EQ(z.Value(), dual_z.Value());
+  EXPECT_FLOAT_EQ(x.GetAdjointValue(), dual_z.Tangent(0));
+  EXPECT_FLOAT_EQ(y.GetAdjointValue(), dual_z.Tangent(1));
+}
+
+TEST(Dual, MixedConstantsAndSecondOrder) {
+  using Dual = ad::Dual<double>;
+  auto x = Dual::Input(2.0);
+  auto y = 3.0 * x * x - 1.0 / x + x * 2.0 - 4.0;
+  EXPECT_DOUBLE_EQ(12 - 0.5 + 4 - 4, y.Value());
+  EXPECT_DOUBLE_EQ(12 + 0.25 + 2, y.Tangent());
+
+  // 嵌套的对偶数：外层tangent的tangent即为二阶导数
+  using Dual2nd = ad::Dual<ad::Dual<double>>;
+  auto t = Dual2nd(ad::Dual<double>::Input(0.7), {ad::Dual<double>(1.0)});
+  auto s = (t * t).Sin();
+  const double u = 0.7 * 0.7;
+  EXPECT_DOUBLE_EQ(std::sin(u), s.Value().Value());
+  EXPECT_DOUBLE_EQ(2 * 0.7 * std::cos(u), s.Tangent().Value());
+  EXPECT_NEAR(2 * std::cos(u) - 4 * u * std::sin(u), s.Tangent().Tangent(),
+              1e-12);
+}
+
+TEST(AutoDiff, BatchCheckpointing) {
+  constexpr std::size_t batch_size = 64;
+  constexpr std::size_t num_layers = 100;
+  std::vector<float> xs(batch_size);
+  for (std::size_t i = 0; i < batch_size; ++i) {
+    xs[i] = static_cast<float>(i) / batch_size;
+  }
+  auto build = [&xs](ad::BatchVariable& w, ad::BatchVariable& x) {
+    w = ad::BatchVariable{{0.9F}};
+    x = ad::BatchVariable{xs};
+    auto h = x;
+    for (std::size_t i = 0; i < num_layers; ++i) {
+      h = (h * w).Sin() + x;
+    }
+    return h;
+  };
+
+  ad::BatchVariable::ClearAllVirablesInPool();
+  ad::BatchVariable w;
+  ad::BatchVariable x;
+  build(w, x).Backpropagation();
+  const std::vector<float> expected_w = w.GetAdjoint();
+  const std::vector<float> expected_x = x.GetAdjoint();
+
+  // 每层三个结点，预算只够保存大约四分之一的中间结果
+  const std::size_t layer_bytes = batch_size * sizeof(float);
+  const std::size_t budget = 3 * num_layers * layer_bytes / 4;
+  ad::BatchVariable::ClearAllVirablesInPool();
+  auto stats = build(w, x).Backpropagation(budget);
+  EXPECT_LE(stats.peak_bytes, budget);
+  EXPECT_GT(stats.num_recomputed, 0U);
+  EXPECT_FLOAT_EQ(expected_w.front(), w.GetAdjoint().front());
+  for (std::size_t i = 0; i < batch_size; ++i) {
+    EXPECT_FLOAT_EQ(expected_x[i], x.GetAdjoint()[i]);
+  }
+
+  ad::BatchVariable::ClearAllVirablesInPool();
+  EXPECT_THROW(build(w, x).Backpropagation(4 * layer_bytes),
+               std::invalid_argument);
+}
+
+TEST(SimdMath, AccuracyBound) {
+  auto sin = [](double x) { return std::sin(x); };
+  auto cos = [](double x) { return std::cos(x); };
+  auto exp = [](double x) { return std::exp(x); };
+  auto log = [](double x) { return std::log(x); };
+  EXPECT_LE(MaxScaledError(ad::simd::Sin, sin, -8192, 8192), 2e-7);
+  EXPECT_LE(MaxScaledError(ad::simd::Sin, sin, -4, 4), 2e-7);
+  EXPECT_LE(MaxScaledError(ad::simd::Cos, cos, -8192, 8192), 2e-7);
+  EXPECT_LE(MaxScaledError(ad::simd::Cos, cos, -4, 4), 2e-7);
+  EXPECT_LE(MaxScaledError(ad::simd::Exp, exp, -87, 88.7), 2e-7);
+  EXPECT_LE(MaxScaledError(ad::simd::Log, log, 1e-30, 1e-3), 2e-7);
+  EXPECT_LE(MaxScaledError(ad::simd::Log, log, 0.25, 4), 2e-7);
+  EXPECT_LE(MaxScaledError(ad::simd::Log, log, 1, 3e38), 2e-7);
+}
+
+TEST(SimdMath, LargeArguments) {
+  // 大小参数混在同一组8个元素中，同时覆盖向量版本和标量版本
+  std::vector<float> x = {1e5F, -1e5F, 3e9F, -3e9F, 1e10F, 0.5F,
+                          8192.5F, -2.0F, 1e30F, 1.0F, -1e10F};
+  std::vector<float> y(x.size());
+  ad::simd::Sin(x.data(), y.data(), x.size());
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    EXPECT_NEAR(std::sin(static_cast<double>(x[i])), y[i], 2e-7) << x[i];
+  }
+  ad::simd::Cos(x.data(), y.data(), x.size());
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    EXPECT_NEAR(std::cos(static_cast<double>(x[i])), y[i], 2e-7) << x[i];
+  }
+
+  const float inf = std::numeric_limits<float>::infinity();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  x = {inf, -inf, nan, 0, 0, 0, 0, 0, inf};
+  y.resize(x.size());
+  ad::simd::Sin(x.data(), y.data(), x.size());
+  EXPECT_TRUE(std::isnan(y[0]) && std::isnan(y[1]) && std::isnan(y[2]));
+  EXPECT_TRUE(std::isnan(y[8]));
+  ad::simd::Cos(x.data(), y.data(), x.size());
+  EXPECT_TRUE(std::isnan(y[0]) && std::isnan(y[1]) && std::isnan(y[2]));
+  EXPECT_TRUE(std::isnan(y[8]));
+}
+
+TEST(SimdMath, SpecialValues) {
+  const float inf = std::numeric_limits<float>::infinity();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  std::vector<float> x = {0, -1, inf, nan, -100, 100, 1, 2, 0.5F};
+  std::vector<float> y(x.size());
+  ad::simd::Log(x.data(), y.data(), x.size());
+  EXPECT_TRUE(std::isinf(y[0]) && y[0] < 0);
+  EXPECT_TRUE(std::isnan(y[1]));
+  EXPECT_TRUE(std::isinf(y[2]) && y[2] > 0);
+  EXPECT_TRUE(std::isnan(y[3]));
+  ad::simd::Exp(x.data(), y.data(), x.size());
+  EXPECT_FLOAT_EQ(1, y[0]);
+  EXPECT_TRUE(std::isinf(y[2]) && y[2] > 0);
+  EXPECT_TRUE(std::isnan(y[3]));
+  EXPECT_FLOAT_EQ(0, y[4]);
+  EXPECT_TRUE(std::isinf(y[5]) && y[5] > 0);
+}
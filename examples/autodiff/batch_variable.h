@@ -0,0 +1,514 @@
+#ifndef EXAMPLES_AUTODIFF_BATCH_VARIABLE_H_
+#define EXAMPLES_AUTODIFF_BATCH_VARIABLE_H_
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "autodiff.h"
+
+namespace ad {
+class BatchVariableImpl;
+
+/*
+ * \brief BatchVariable是批量版本的Variable，结点的值和伴随值都是连续的float数组
+ * 一个计算图一次性地处理batch中的所有样本，建图、拓扑排序以及op的虚函数调用
+ * 对整个batch只发生一次，逐元素的计算交给OpBase中的批量kernel完成。
+ *
+ * \note batch大小为1的变量会被广播到另一个输入的batch大小，
+ * 典型的用法是模型参数，它的伴随值为整个batch上梯度之和。
+ * BatchVariable只支持一阶导数。
+ */
+class BatchVariable {
+ public:
+  BatchVariable() = default;
+
+  explicit BatchVariable(std::vector<float> values);
+
+  BatchVariable operator+(const BatchVariable& rhs) const;
+  BatchVariable operator-(const BatchVariable& rhs) const;
+  BatchVariable operator*(const BatchVariable& rhs) const;
+  BatchVariable operator/(const BatchVariable& rhs) const;
+  BatchVariable operator-() const;
+  BatchVariable Sin() const;
+  BatchVariable Cos() const;
+  BatchVariable Log() const;
+  BatchVariable Exp() const;
+
+  explicit operator bool() { return variable_ != nullptr; }
+
+  const std::vector<float>& Value();
+
+  const std::vector<float>& Value() const;
+
+  std::size_t BatchSize() const;
+
+  std::string Name() const;
+
+  std::size_t NumInputs() const;
+
+  const BatchVariable& Inputs(std::size_t i) const;
+
+  const OpBase* Op() const;
+
+  // 中间结点的伴随值只在本次反向传播中有效，
+  // 叶子结点的伴随值会一直累加，直到调用ZeroGradient
+  void Backpropagation();
+
+  struct CheckpointStats {
+    // 中间结点的值和伴随值同时占用内存的峰值，单位为字节
+    std::size_t peak_bytes = 0;
+    // 反向传播中被重新计算的结点数
+    std::size_t num_recomputed = 0;
+  };
+
+  // 带checkpoint的反向传播，中间结点的值和伴随值占用的内存不超过memory_budget，
+  // 预算无法满足时抛出异常。结束后只有叶子结点保留值和伴随值
+  CheckpointStats Backpropagation(std::size_t memory_budget);
+
+  const std::vector<float>& GetAdjoint() const;
+
+  bool operator==(const BatchVariable& rhs) {
+    return rhs.variable_ == variable_;
+  }
+
+  static void ZeroGradient();
+  static void ClearAllVirablesInPool();
+
+ private:
+  friend BatchVariableImpl;
+
+  BatchVariable(BatchVariableImpl* var);
+
+  BatchVariable NewNode(const OpBase* op) const;
+  BatchVariable NewNode(const OpBase* op,
+                        const BatchVariable& rhs) const;
+
+  static void Forward(const std::vector<BatchVariableImpl*>& sorted_vec);
+  // 计算单个结点的值，要求输入的值都已经存在
+  static void ComputeNode(BatchVariableImpl* var, std::vector<float>* buffers);
+  // 把单个结点的伴随值传播给输入，要求输入的伴随值都已经分配
+  static void GradientNode(BatchVariableImpl* var,
+                           std::vector<float>* value_buffers,
+                           std::vector<float>* adjoint_buffers);
+
+ private:
+  BatchVariableImpl* variable_ = nullptr;
+};
+
+class BatchVariableImpl {
+  friend BatchVariable;
+  friend BasicTape<BatchVariableImpl>;
+
+ public:
+  BatchVariableImpl(const BatchVariableImpl&) = delete;
+  BatchVariableImpl& operator=(const BatchVariableImpl&) = delete;
+
+  // 与VariableImpl相同，每个线程有自己的Tape
+  static thread_local BasicTape<BatchVariableImpl> tape_;
+
+ private:
+  BatchVariableImpl(std::size_t index, std::size_t batch_size)
+      : index_(index), batch_size_(batch_size) {}
+
+  void Reinit(std::size_t index, std::size_t batch_size) {
+    inputs_.clear();
+    op_ = nullptr;
+    value_.clear();
+    adjoint_.clear();
+    visit_mark_ = 0;
+    index_ = index;
+    batch_size_ = batch_size;
+  }
+
+  std::size_t NumInputs() const { return inputs_.size(); }
+
+  BatchVariableImpl* InputNode(std::size_t i) const {
+    return inputs_[i].variable_;
+  }
+
+  std::vector<BatchVariable> inputs_;
+  const OpBase* op_ = nullptr;
+  std::vector<float> value_;
+  std::vector<float> adjoint_;
+  std::size_t index_;
+  std::size_t batch_size_;
+  std::size_t visit_mark_ = 0;
+};
+
+thread_local BasicTape<BatchVariableImpl> BatchVariableImpl::tape_;
+
+namespace {
+// 逐元素的kernel要求所有输入长度相同，batch大小为1的输入先展开到buffer中
+const float* BroadcastValue(const std::vector<float>& value, std::size_t n,
+                            std::vector<float>& buffer) {
+  if (value.size() == n) {
+    return value.data();
+  }
+  buffer.assign(n, value.front());
+  return buffer.data();
+}
+}  // namespace
+
+BatchVariable::BatchVariable(BatchVariableImpl* var) : variable_(var) {}
+
+BatchVariable::BatchVariable(std::vector<float> values) {
+  if (values.empty()) {
+    throw std::invalid_argument("batch size must be greater than 0");
+  }
+  variable_ = BatchVariableImpl::tape_.NewVariable(values.size());
+  variable_->value_ = std::move(values);
+}
+
+BatchVariable BatchVariable::NewNode(const OpBase* op) const {
+  AD_PROFILE_NODE(op);
+  auto var_ref =
+      BatchVariable{BatchVariableImpl::tape_.NewVariable(BatchSize())};
+  var_ref.variable_->op_ = op;
+  var_ref.variable_->inputs_.emplace_back(*this);
+  return var_ref;
+}
+
+BatchVariable BatchVariable::NewNode(const OpBase* op,
+                                     const BatchVariable& rhs) const {
+  const std::size_t lhs_size = BatchSize();
+  const std::size_t rhs_size = rhs.BatchSize();
+  if (lhs_size != rhs_size && lhs_size != 1 && rhs_size != 1) {
+    throw std::invalid_argument("batch size mismatch: " +
+                                std::to_string(lhs_size) + " vs " +
+                                std::to_string(rhs_size));
+  }
+  AD_PROFILE_NODE(op);
+  auto var_ref = BatchVariable{
+      BatchVariableImpl::tape_.NewVariable(std::max(lhs_size, rhs_size))};
+  var_ref.variable_->op_ = op;
+  var_ref.variable_->inputs_.emplace_back(*this);
+  var_ref.variable_->inputs_.emplace_back(rhs);
+  return var_ref;
+}
+
+BatchVariable BatchVariable::operator+(const BatchVariable& rhs) const {
+  return NewNode(GetOp<PlusOp>("plus"), rhs);
+}
+
+BatchVariable BatchVariable::operator-(const BatchVariable& rhs) const {
+  return NewNode(GetOp<MinusOp>("minus"), rhs);
+}
+
+BatchVariable BatchVariable::operator*(const BatchVariable& rhs) const {
+  return NewNode(GetOp<MultipleOp>("mul"), rhs);
+}
+
+BatchVariable BatchVariable::operator/(const BatchVariable& rhs) const {
+  return NewNode(GetOp<DivideOp>("div"), rhs);
+}
+
+BatchVariable BatchVariable::operator-() const {
+  return NewNode(GetOp<Negitive>("neg"));
+}
+
+BatchVariable BatchVariable::Sin() const {
+  return NewNode(GetOp<SinOp>("sin"));
+}
+
+BatchVariable BatchVariable::Cos() const {
+  return NewNode(GetOp<CosOp>("cos"));
+}
+
+BatchVariable BatchVariable::Log() const {
+  return NewNode(GetOp<LogOp>("log"));
+}
+
+BatchVariable BatchVariable::Exp() const {
+  return NewNode(GetOp<ExpOp>("exp"));
+}
+
+void BatchVariable::ComputeNode(BatchVariableImpl* var,
+                                std::vector<float>* buffers) {
+  AD_PROFILE_OP(var->op_, kForward);
+  const std::size_t n = var->batch_size_;
+  const float* input_values[2];
+  for (std::size_t j = 0; j < var->NumInputs(); ++j) {
+    input_values[j] = BroadcastValue(var->InputNode(j)->value_, n, buffers[j]);
+  }
+  var->value_.resize(n);
+  var->op_->Compute(input_values, var->value_.data(), n);
+}
+
+void BatchVariable::GradientNode(BatchVariableImpl* var,
+                                 std::vector<float>* value_buffers,
+                                 std::vector<float>* adjoint_buffers) {
+  AD_PROFILE_OP(var->op_, kGradient);
+  const std::size_t n = var->batch_size_;
+  const float* input_values[2];
+  float* input_adjoints[2];
+  for (std::size_t j = 0; j < var->NumInputs(); ++j) {
+    BatchVariableImpl* input = var->InputNode(j);
+    input_values[j] = BroadcastValue(input->value_, n, value_buffers[j]);
+    if (input->batch_size_ == n) {
+      input_adjoints[j] = input->adjoint_.data();
+    } else {
+      adjoint_buffers[j].assign(n, .0F);
+      input_adjoints[j] = adjoint_buffers[j].data();
+    }
+  }
+  var->op_->Gradient(input_values, var->value_.data(), var->adjoint_.data(),
+                     input_adjoints, n);
+  // 被广播的输入，其伴随值为展开后各个位置的伴随值之和
+  for (std::size_t j = 0; j < var->NumInputs(); ++j) {
+    BatchVariableImpl* input = var->InputNode(j);
+    if (input->batch_size_ != n) {
+      input->adjoint_.front() += std::accumulate(
+          adjoint_buffers[j].begin(), adjoint_buffers[j].end(), .0F);
+    }
+  }
+}
+
+void BatchVariable::Forward(const std::vector<BatchVariableImpl*>& sorted_vec) {
+  std::vector<float> broadcast_values[2];
+  for (auto iter = sorted_vec.rbegin(); iter != sorted_vec.rend(); ++iter) {
+    if ((*iter)->op_) {
+      ComputeNode(*iter, broadcast_values);
+    }
+  }
+}
+
+void BatchVariable::Backpropagation() {
+  AD_PROFILE_REGION("BatchBackpropagation");
+  std::vector<BatchVariableImpl*> sorted_vec =
+      BatchVariableImpl::tape_.TopoSort(variable_);
+  Forward(sorted_vec);
+  for (BatchVariableImpl* var : sorted_vec) {
+    if (var->op_ || var->adjoint_.empty()) {
+      var->adjoint_.assign(var->batch_size_, .0F);
+    }
+  }
+  for (auto& adjoint : variable_->adjoint_) {
+    adjoint += 1.0F;
+  }
+
+  std::vector<float> broadcast_values[2];
+  std::vector<float> broadcast_adjoints[2];
+  for (BatchVariableImpl* var : sorted_vec) {
+    if (var->op_) {
+      GradientNode(var, broadcast_values, broadcast_adjoints);
+    }
+  }
+}
+
+namespace {
+// checkpoint模式下中间结点的值和伴随值的分配与释放，同时统计占用的内存
+class BufferTracker {
+ public:
+  void Allocate(std::vector<float>& buffer, std::size_t n) {
+    if (buffer.empty()) {
+      bytes_ += n * sizeof(float);
+      peak_bytes_ = std::max(peak_bytes_, bytes_);
+    }
+    buffer.assign(n, .0F);
+  }
+
+  void Release(std::vector<float>& buffer) {
+    bytes_ -= buffer.size() * sizeof(float);
+    std::vector<float>().swap(buffer);
+  }
+
+  std::size_t PeakBytes() const { return peak_bytes_; }
+
+ private:
+  std::size_t bytes_ = 0;
+  std::size_t peak_bytes_ = 0;
+};
+}  // namespace
+
+/*
+ * 按前向计算的顺序把L个op结点切分为长度为s的段，每段最后一个结点是checkpoint。
+ * 前向计算时每段结束后只保留checkpoint的值；反向传播逐段倒序进行，
+ * 先从前一个checkpoint重新计算本段的值，再对本段做反向传播，完成后整段释放。
+ * 同时存在的缓冲区不超过ceil(L / s)个checkpoint，加上当前段的s个值、
+ * s个伴随值以及上一个checkpoint的伴随值，s取满足预算的最小值，
+ * 使重新计算的结点数最少。
+ *
+ * 对链式结构，每个结点的输入都在本段或者是上一个checkpoint，上述上界是严格的；
+ * 一般的DAG中跨段引用的结点会被按需递归地重新计算。
+ */
+BatchVariable::CheckpointStats BatchVariable::Backpropagation(
+    std::size_t memory_budget) {
+  const std::vector<BatchVariableImpl*> sorted_vec =
+      BatchVariableImpl::tape_.TopoSort(variable_);
+  std::vector<BatchVariableImpl*> ops;
+  std::size_t buffer_bytes = 0;
+  for (auto iter = sorted_vec.rbegin(); iter != sorted_vec.rend(); ++iter) {
+    if ((*iter)->op_) {
+      ops.push_back(*iter);
+      buffer_bytes =
+          std::max(buffer_bytes, (*iter)->batch_size_ * sizeof(float));
+    }
+  }
+  // 中间结点已有的值和伴随值全部丢弃，由下面的过程重新分配和统计
+  for (BatchVariableImpl* var : sorted_vec) {
+    if (var->op_) {
+      std::vector<float>().swap(var->value_);
+      std::vector<float>().swap(var->adjoint_);
+    } else if (var->adjoint_.empty()) {
+      var->adjoint_.assign(var->batch_size_, .0F);
+    }
+  }
+  CheckpointStats stats;
+  const std::size_t num_ops = ops.size();
+  if (num_ops == 0) {
+    for (auto& adjoint : variable_->adjoint_) {
+      adjoint += 1.0F;
+    }
+    return stats;
+  }
+
+  const std::size_t max_buffers = memory_budget / buffer_bytes;
+  std::size_t segment = 1;
+  while (segment <= num_ops &&
+         (num_ops + segment - 1) / segment + 2 * segment + 1 > max_buffers) {
+    ++segment;
+  }
+  if (segment > num_ops) {
+    throw std::invalid_argument("memory budget is too small for checkpointing");
+  }
+  auto is_checkpoint = [segment, num_ops](std::size_t pos) {
+    return pos % segment == segment - 1 || pos + 1 == num_ops;
+  };
+  std::vector<char> checkpoints(BatchVariableImpl::tape_.Size(), false);
+
+  BufferTracker tracker;
+  std::vector<float> broadcast_values[2];
+  std::vector<float> broadcast_adjoints[2];
+  // 当前段中计算出的结点，包括从更早的段中按需重新计算的结点
+  std::vector<BatchVariableImpl*> recomputed;
+  // 确保root的值存在，缺失的值沿着输入递归地重新计算
+  auto ensure_value = [&](BatchVariableImpl* root, bool count_recompute) {
+    std::vector<std::pair<BatchVariableImpl*, std::size_t>> stack;
+    if (root->op_ && root->value_.empty()) {
+      stack.emplace_back(root, 0);
+    }
+    while (!stack.empty()) {
+      auto& [var, next_input] = stack.back();
+      if (next_input == var->NumInputs()) {
+        tracker.Allocate(var->value_, var->batch_size_);
+        ComputeNode(var, broadcast_values);
+        if (count_recompute) {
+          ++stats.num_recomputed;
+        }
+        recomputed.push_back(var);
+        stack.pop_back();
+        continue;
+      }
+      BatchVariableImpl* input = var->InputNode(next_input++);
+      if (input->op_ && input->value_.empty()) {
+        stack.emplace_back(input, 0);
+      }
+    }
+  };
+  // 前向计算，每段结束后只保留checkpoint
+  for (std::size_t begin = 0; begin < num_ops; begin += segment) {
+    const std::size_t end = std::min(begin + segment, num_ops);
+    for (std::size_t pos = begin; pos < end; ++pos) {
+      ensure_value(ops[pos], false);
+    }
+    for (std::size_t pos = begin; pos < end; ++pos) {
+      if (is_checkpoint(pos)) {
+        checkpoints[ops[pos]->index_] = true;
+      }
+    }
+    for (BatchVariableImpl* var : recomputed) {
+      if (!checkpoints[var->index_]) {
+        tracker.Release(var->value_);
+      }
+    }
+    recomputed.clear();
+  }
+
+  // 反向传播，逐段倒序进行
+  tracker.Allocate(variable_->adjoint_, variable_->batch_size_);
+  std::fill(variable_->adjoint_.begin(), variable_->adjoint_.end(), 1.0F);
+  const std::size_t last_begin = (num_ops - 1) / segment * segment;
+  for (std::size_t begin = last_begin + segment; begin >= segment;) {
+    begin -= segment;
+    const std::size_t end = std::min(begin + segment, num_ops);
+    for (std::size_t pos = begin; pos < end; ++pos) {
+      ensure_value(ops[pos], true);
+    }
+    for (std::size_t pos = end; pos-- > begin;) {
+      BatchVariableImpl* var = ops[pos];
+      for (std::size_t j = 0; j < var->NumInputs(); ++j) {
+        BatchVariableImpl* input = var->InputNode(j);
+        ensure_value(input, true);
+        if (input->adjoint_.empty()) {
+          tracker.Allocate(input->adjoint_, input->batch_size_);
+        }
+      }
+      GradientNode(var, broadcast_values, broadcast_adjoints);
+      tracker.Release(var->adjoint_);
+    }
+    // 本段的值（包括段末的checkpoint）以及从更早的段中重新计算出的值都不再需要
+    for (std::size_t pos = begin; pos < end; ++pos) {
+      tracker.Release(ops[pos]->value_);
+    }
+    for (BatchVariableImpl* var : recomputed) {
+      tracker.Release(var->value_);
+    }
+    recomputed.clear();
+  }
+  stats.peak_bytes = tracker.PeakBytes();
+  return stats;
+}
+
+const std::vector<float>& BatchVariable::Value() {
+  if (variable_->op_) {
+    Forward(BatchVariableImpl::tape_.TopoSort(variable_));
+  }
+  return variable_->value_;
+}
+
+const std::vector<float>& BatchVariable::Value() const {
+  return variable_->value_;
+}
+
+std::size_t BatchVariable::BatchSize() const { return variable_->batch_size_; }
+
+std::string BatchVariable::Name() const {
+  return "v" + std::to_string(variable_->index_);
+}
+
+std::size_t BatchVariable::NumInputs() const {
+  return variable_->inputs_.size();
+}
+
+const BatchVariable& BatchVariable::Inputs(std::size_t i) const {
+  return variable_->inputs_[i];
+}
+
+const OpBase* BatchVariable::Op() const {
+  return variable_->op_;
+}
+
+const std::vector<float>& BatchVariable::GetAdjoint() const {
+  if (variable_->adjoint_.empty()) {
+    throw std::invalid_argument("Run backward before get adjoint");
+  }
+  return variable_->adjoint_;
+}
+
+void BatchVariable::ZeroGradient() {
+  for (std::size_t i = 0; i < BatchVariableImpl::tape_.Size(); ++i) {
+    BatchVariableImpl::tape_.At(i)->adjoint_.clear();
+  }
+}
+
+void BatchVariable::ClearAllVirablesInPool() {
+  BatchVariableImpl::tape_.Reset();
+}
+
+}  // namespace ad
+
+#endif  // EXAMPLES_AUTODIFF_BATCH_VARIABLE_H_
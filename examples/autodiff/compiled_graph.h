@@ -0,0 +1,447 @@
+#ifndef EXAMPLES_AUTODIFF_COMPILED_GRAPH_H_
+#define EXAMPLES_AUTODIFF_COMPILED_GRAPH_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "autodiff.h"
+
+namespace ad {
+
+/*
+ * \brief CompiledGraph是计算图编译后的形式，由Variable::Compile()生成。
+ * 结点按前向计算的顺序编号为slot，叶子结点占据前NumLeaves()个slot，
+ * 第k条指令的结果写入slot NumLeaves() + k。指令只包含操作码和输入的slot编号，
+ * 前向与反向传播都是对指令数组的一次线性扫描，用switch代替虚函数调用，
+ * 结点的值和伴随值各自存放在连续的float数组中。
+ *
+ * \note 编译之后计算图的结构固定，但叶子的值可以反复修改，
+ * 适合训练循环中同一个模型对不同数据反复求梯度的场景。
+ * 编译结果不再依赖Tape，Leaves()返回的Variable则在Tape重置之后失效。
+ * 只支持一阶导数。
+ *
+ * 指令和叶子的初始值存放在一块连续的内存中，布局与Save()写出的文件相同：
+ *   Header | float leaf_values[L] | uint32 lhs[n] | uint32 rhs[n] |
+ *   uint8 codes[n]
+ * 所有字段按本机字节序存放。Load()用mmap映射文件，指令直接引用映射的内存，
+ * 只检查每条指令的输入编号和操作码是否合法，不需要解析或重新建图。
+ * 拷贝CompiledGraph时共享指令，只复制值和伴随值数组。
+ */
+class CompiledGraph {
+ public:
+  std::size_t NumLeaves() const { return header_->num_leaves; }
+
+  std::size_t NumInstructions() const { return num_instructions_; }
+
+  // 第i个叶子对应的Variable
+  const std::vector<Variable>& Leaves() const { return leaves_; }
+
+  // 叶子在编译结果中的编号，leaf不是该计算图的叶子时抛出异常
+  std::size_t LeafIndex(const Variable& leaf) const;
+
+  // 按顺序返回每个leaf的编号，不在计算图中的返回NumLeaves()
+  std::vector<std::size_t> LeafIndices(
+      const std::vector<Variable>& leaves) const;
+
+  void SetLeafValue(std::size_t leaf, float value) { values_[leaf] = value; }
+
+  float LeafValue(std::size_t leaf) const { return values_[leaf]; }
+
+  // 计算所有结点的值，返回root的值
+  float Forward();
+
+  // 使用最近一次Forward()的结果计算伴随值，每次调用都会重新计算
+  void Backward();
+
+  float Value() const { return values_[output_slot_]; }
+
+  float LeafAdjoint(std::size_t leaf) const { return adjoints_[leaf]; }
+
+  // 以任意标量类型T做一次前向和反向传播，values的前NumLeaves()个元素
+  // 为叶子的值，返回时adjoints中是所有slot的伴随值。
+  // T为Dual时即为forward-over-reverse：伴随值的切向量就是Hessian与
+  // 叶子切向量的乘积。不修改CompiledGraph本身
+  template <typename T>
+  void Evaluate(std::vector<T>& values, std::vector<T>& adjoints) const;
+
+  // 把指令和编译时叶子的值写入文件，失败时抛出std::runtime_error
+  void Save(const std::string& path) const;
+
+  // 映射Save()写出的文件，叶子的值为保存时的值。
+  // 加载的计算图没有对应的Variable，Leaves()为空。
+  // 文件无法读取或内容不合法时抛出std::runtime_error
+  static CompiledGraph Load(const std::string& path);
+
+ private:
+  friend Variable;
+
+  struct Header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t num_leaves;
+    std::uint32_t num_instructions;
+    std::uint32_t output_slot;
+    std::uint32_t reserved;
+  };
+
+  static constexpr char kMagic[4] = {'A', 'D', 'G', 'R'};
+  static constexpr std::uint32_t kVersion = 1;
+
+  static std::size_t ImageSize(const Header& header) {
+    return sizeof(Header) + sizeof(float) * header.num_leaves +
+           (2 * sizeof(std::uint32_t) + sizeof(OpCode)) *
+               header.num_instructions;
+  }
+
+  CompiledGraph() = default;
+
+  // 让指令指向image中的各个数组，并用保存的叶子值初始化values_
+  void Attach(std::shared_ptr<const void> image);
+
+  // 指令，按struct of arrays的方式存放在image_中
+  std::shared_ptr<const void> image_;
+  const Header* header_ = nullptr;
+  const OpCode* codes_ = nullptr;
+  const std::uint32_t* lhs_ = nullptr;
+  const std::uint32_t* rhs_ = nullptr;
+  std::size_t num_instructions_ = 0;
+
+  std::vector<float> values_;
+  std::vector<float> adjoints_;
+  std::vector<Variable> leaves_;
+  std::uint32_t output_slot_ = 0;
+};
+
+CompiledGraph Variable::Compile() const {
+  std::vector<VariableImpl*> sorted_vec =
+      VariableImpl::tape_.TopoSort(variable_);
+  CompiledGraph graph;
+  // 以结点在Tape中的编号为下标，记录每个结点的slot编号
+  std::vector<std::uint32_t> slots(VariableImpl::tape_.Size());
+  std::vector<VariableImpl*> ops;
+  for (auto iter = sorted_vec.rbegin(); iter != sorted_vec.rend(); ++iter) {
+    VariableImpl* var = *iter;
+    if (var->op_ == nullptr) {
+      slots[var->index_] = static_cast<std::uint32_t>(graph.leaves_.size());
+      graph.leaves_.push_back(Variable{var});
+    } else {
+      ops.push_back(var);
+    }
+  }
+  const std::size_t num_leaves = graph.leaves_.size();
+  for (std::size_t k = 0; k < ops.size(); ++k) {
+    slots[ops[k]->index_] = static_cast<std::uint32_t>(num_leaves + k);
+  }
+
+  CompiledGraph::Header header{};
+  std::memcpy(header.magic, CompiledGraph::kMagic, sizeof(header.magic));
+  header.version = CompiledGraph::kVersion;
+  header.num_leaves = static_cast<std::uint32_t>(num_leaves);
+  header.num_instructions = static_cast<std::uint32_t>(ops.size());
+  header.output_slot = slots[variable_->index_];
+  auto buffer = std::make_shared<std::vector<std::byte>>(
+      CompiledGraph::ImageSize(header));
+  std::byte* data = buffer->data();
+  std::memcpy(data, &header, sizeof(header));
+  auto* leaf_values = reinterpret_cast<float*>(data + sizeof(header));
+  auto* lhs = reinterpret_cast<std::uint32_t*>(leaf_values + num_leaves);
+  auto* rhs = lhs + ops.size();
+  auto* codes = reinterpret_cast<OpCode*>(rhs + ops.size());
+  for (std::size_t i = 0; i < num_leaves; ++i) {
+    leaf_values[i] = graph.leaves_[i].variable_->cached_value_;
+  }
+  for (std::size_t k = 0; k < ops.size(); ++k) {
+    VariableImpl* var = ops[k];
+    codes[k] = var->op_->Code();
+    lhs[k] = slots[var->InputNode(0)->index_];
+    rhs[k] = var->NumInputs() > 1 ? slots[var->InputNode(1)->index_] : 0;
+  }
+  graph.Attach(std::shared_ptr<const void>(buffer, data));
+  graph.Forward();
+  return graph;
+}
+
+void CompiledGraph::Attach(std::shared_ptr<const void> image) {
+  image_ = std::move(image);
+  const auto* data = static_cast<const std::byte*>(image_.get());
+  header_ = reinterpret_cast<const Header*>(data);
+  num_instructions_ = header_->num_instructions;
+  const auto* leaf_values =
+      reinterpret_cast<const float*>(data + sizeof(Header));
+  lhs_ = reinterpret_cast<const std::uint32_t*>(leaf_values +
+                                                header_->num_leaves);
+  rhs_ = lhs_ + num_instructions_;
+  codes_ = reinterpret_cast<const OpCode*>(rhs_ + num_instructions_);
+  output_slot_ = header_->output_slot;
+  values_.assign(header_->num_leaves + num_instructions_, .0F);
+  std::copy(leaf_values, leaf_values + header_->num_leaves, values_.begin());
+  adjoints_.assign(values_.size(), .0F);
+}
+
+void CompiledGraph::Save(const std::string& path) const {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(static_cast<const char*>(image_.get()),
+            static_cast<std::streamsize>(ImageSize(*header_)));
+  if (!out) {
+    throw std::runtime_error("Failed to write compiled graph: " + path);
+  }
+}
+
+CompiledGraph CompiledGraph::Load(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open compiled graph: " + path);
+  }
+  struct stat file_stat {};
+  if (fstat(fd, &file_stat) != 0 ||
+      static_cast<std::size_t>(file_stat.st_size) < sizeof(Header)) {
+    close(fd);
+    throw std::runtime_error("Invalid compiled graph: " + path);
+  }
+  const auto size = static_cast<std::size_t>(file_stat.st_size);
+  void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    throw std::runtime_error("Failed to map compiled graph: " + path);
+  }
+  std::shared_ptr<const void> image(
+      addr, [size](const void* p) { munmap(const_cast<void*>(p), size); });
+
+  const auto* header = static_cast<const Header*>(addr);
+  if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header->version != kVersion || header->num_leaves == 0 ||
+      ImageSize(*header) != size ||
+      header->output_slot >= header->num_leaves + header->num_instructions) {
+    throw std::runtime_error("Invalid compiled graph: " + path);
+  }
+  CompiledGraph graph;
+  graph.Attach(std::move(image));
+  // 指令的输入只能是之前的slot，这样Forward()和Backward()不会越界
+  for (std::size_t k = 0; k < graph.num_instructions_; ++k) {
+    const std::size_t slot = header->num_leaves + k;
+    if (graph.lhs_[k] >= slot || graph.rhs_[k] >= slot ||
+        static_cast<std::uint8_t>(graph.codes_[k]) >
+            static_cast<std::uint8_t>(OpCode::kExp)) {
+      throw std::runtime_error("Invalid compiled graph: " + path);
+    }
+  }
+  return graph;
+}
+
+std::size_t CompiledGraph::LeafIndex(const Variable& leaf) const {
+  for (std::size_t i = 0; i < leaves_.size(); ++i) {
+    if (leaves_[i].variable_ == leaf.variable_) {
+      return i;
+    }
+  }
+  throw std::invalid_argument("Variable is not a leaf of the compiled graph");
+}
+
+std::vector<std::size_t> CompiledGraph::LeafIndices(
+    const std::vector<Variable>& leaves) const {
+  // 以结点在Tape中的编号为下标
+  std::vector<std::size_t> indices(VariableImpl::tape_.Size(), NumLeaves());
+  for (std::size_t i = 0; i < leaves_.size(); ++i) {
+    indices[leaves_[i].variable_->index_] = i;
+  }
+  std::vector<std::size_t> result;
+  for (const auto& leaf : leaves) {
+    result.push_back(indices[leaf.variable_->index_]);
+  }
+  return result;
+}
+
+template <typename T>
+void CompiledGraph::Evaluate(std::vector<T>& values,
+                             std::vector<T>& adjoints) const {
+  using std::cos;
+  using std::exp;
+  using std::log;
+  using std::sin;
+  values.resize(NumLeaves() + num_instructions_);
+  T* v = values.data();
+  T* out = v + NumLeaves();
+  for (std::size_t k = 0; k < num_instructions_; ++k) {
+    const T& x = v[lhs_[k]];
+    const T& y = v[rhs_[k]];
+    switch (codes_[k]) {
+      case OpCode::kPlus:
+        out[k] = x + y;
+        break;
+      case OpCode::kMinus:
+        out[k] = x - y;
+        break;
+      case OpCode::kMul:
+        out[k] = x * y;
+        break;
+      case OpCode::kDiv:
+        out[k] = x / y;
+        break;
+      case OpCode::kNeg:
+        out[k] = -x;
+        break;
+      case OpCode::kSin:
+        out[k] = sin(x);
+        break;
+      case OpCode::kCos:
+        out[k] = cos(x);
+        break;
+      case OpCode::kLog:
+        out[k] = log(x);
+        break;
+      case OpCode::kExp:
+        out[k] = exp(x);
+        break;
+    }
+  }
+
+  adjoints.assign(values.size(), T(0));
+  adjoints[output_slot_] = T(1);
+  T* a = adjoints.data();
+  const T* out_adjoint = a + NumLeaves();
+  for (std::size_t k = num_instructions_; k-- > 0;) {
+    const T g = out_adjoint[k];
+    const T& x = v[lhs_[k]];
+    const T& y = v[rhs_[k]];
+    T& dx = a[lhs_[k]];
+    T& dy = a[rhs_[k]];
+    switch (codes_[k]) {
+      case OpCode::kPlus:
+        dx += g;
+        dy += g;
+        break;
+      case OpCode::kMinus:
+        dx += g;
+        dy -= g;
+        break;
+      case OpCode::kMul:
+        dx += g * y;
+        dy += g * x;
+        break;
+      case OpCode::kDiv:
+        dx += g / y;
+        dy -= g * out[k] / y;
+        break;
+      case OpCode::kNeg:
+        dx -= g;
+        break;
+      case OpCode::kSin:
+        dx += g * cos(x);
+        break;
+      case OpCode::kCos:
+        dx -= g * sin(x);
+        break;
+      case OpCode::kLog:
+        dx += g / x;
+        break;
+      case OpCode::kExp:
+        dx += g * out[k];
+        break;
+    }
+  }
+}
+
+float CompiledGraph::Forward() {
+  float* v = values_.data();
+  float* out = v + NumLeaves();
+  for (std::size_t k = 0; k < num_instructions_; ++k) {
+    const float x = v[lhs_[k]];
+    const float y = v[rhs_[k]];
+    switch (codes_[k]) {
+      case OpCode::kPlus:
+        out[k] = x + y;
+        break;
+      case OpCode::kMinus:
+        out[k] = x - y;
+        break;
+      case OpCode::kMul:
+        out[k] = x * y;
+        break;
+      case OpCode::kDiv:
+        out[k] = x / y;
+        break;
+      case OpCode::kNeg:
+        out[k] = -x;
+        break;
+      case OpCode::kSin:
+        simd::Sin(&x, &out[k], 1);
+        break;
+      case OpCode::kCos:
+        simd::Cos(&x, &out[k], 1);
+        break;
+      case OpCode::kLog:
+        simd::Log(&x, &out[k], 1);
+        break;
+      case OpCode::kExp:
+        simd::Exp(&x, &out[k], 1);
+        break;
+    }
+  }
+  return Value();
+}
+
+void CompiledGraph::Backward() {
+  std::fill(adjoints_.begin(), adjoints_.end(), .0F);
+  adjoints_[output_slot_] = 1.0F;
+  const float* v = values_.data();
+  const float* out = v + NumLeaves();
+  float* a = adjoints_.data();
+  const float* out_adjoint = a + NumLeaves();
+  for (std::size_t k = num_instructions_; k-- > 0;) {
+    const float g = out_adjoint[k];
+    const float x = v[lhs_[k]];
+    const float y = v[rhs_[k]];
+    float& dx = a[lhs_[k]];
+    float& dy = a[rhs_[k]];
+    switch (codes_[k]) {
+      case OpCode::kPlus:
+        dx += g;
+        dy += g;
+        break;
+      case OpCode::kMinus:
+        dx += g;
+        dy -= g;
+        break;
+      case OpCode::kMul:
+        dx += g * y;
+        dy += g * x;
+        break;
+      case OpCode::kDiv:
+        dx += g / y;
+        dy -= g * out[k] / y;
+        break;
+      case OpCode::kNeg:
+        dx -= g;
+        break;
+      case OpCode::kSin:
+        simd::AccumulateCos(&x, &g, &dx, 1);
+        break;
+      case OpCode::kCos:
+        simd::AccumulateNegSin(&x, &g, &dx, 1);
+        break;
+      case OpCode::kLog:
+        dx += g / x;
+        break;
+      case OpCode::kExp:
+        dx += g * out[k];
+        break;
+    }
+  }
+}
+
+}  // namespace ad
+
+#endif  // EXAMPLES_AUTODIFF_COMPILED_GRAPH_H_
@@ -0,0 +1,172 @@
+#ifndef EXAMPLES_AUTODIFF_DUAL_H_
+#define EXAMPLES_AUTODIFF_DUAL_H_
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+namespace ad {
+
+/*
+ * \brief 前向模式自动微分使用的对偶数 value + sum(tangent[i] * e_i)，
+ * 每个运算同时计算值和N个方向上的方向导数。
+ * 输入个数较少、输出较多的函数，N取输入个数时一次前向计算即可得到整个Jacobian，
+ * 不需要计算图，也不做任何堆内存分配，所有运算都可以被内联。
+ *
+ * \note T可以是float、double，也可以是另一个Dual，用于计算高阶导数。
+ * 支持的运算与Variable相同：+、-、*、/、取负、sin、cos、log、exp。
+ */
+template <typename T, std::size_t N = 1>
+class Dual {
+ public:
+  using Tangents = std::array<T, N>;
+
+  constexpr Dual() : value_(), tangents_() {}
+
+  // 常量，所有方向导数为0，允许隐式转换以便与普通数值混合运算
+  constexpr Dual(T value) : value_(value), tangents_() {}  // NOLINT
+
+  constexpr Dual(T value, const Tangents& tangents)
+      : value_(value), tangents_(tangents) {}
+
+  // 第lane个自变量，它在第lane个方向上的导数为1
+  static constexpr Dual Input(T value, std::size_t lane = 0) {
+    Dual result(value);
+    result.tangents_[lane] = T(1);
+    return result;
+  }
+
+  constexpr const T& Value() const { return value_; }
+
+  constexpr const T& Tangent(std::size_t lane = 0) const {
+    return tangents_[lane];
+  }
+
+  constexpr const Tangents& GetTangents() const { return tangents_; }
+
+  constexpr Dual operator+(const Dual& rhs) const {
+    Dual result(value_ + rhs.value_);
+    for (std::size_t i = 0; i < N; ++i) {
+      result.tangents_[i] = tangents_[i] + rhs.tangents_[i];
+    }
+    return result;
+  }
+
+  constexpr Dual operator-(const Dual& rhs) const {
+    Dual result(value_ - rhs.value_);
+    for (std::size_t i = 0; i < N; ++i) {
+      result.tangents_[i] = tangents_[i] - rhs.tangents_[i];
+    }
+    return result;
+  }
+
+  constexpr Dual operator*(const Dual& rhs) const {
+    Dual result(value_ * rhs.value_);
+    for (std::size_t i = 0; i < N; ++i) {
+      result.tangents_[i] =
+          tangents_[i] * rhs.value_ + value_ * rhs.tangents_[i];
+    }
+    return result;
+  }
+
+  // (x / y)' = (x' - (x / y) * y') / y
+  constexpr Dual operator/(const Dual& rhs) const {
+    const T inv = T(1) / rhs.value_;
+    Dual result(value_ * inv);
+    for (std::size_t i = 0; i < N; ++i) {
+      result.tangents_[i] =
+          (tangents_[i] - result.value_ * rhs.tangents_[i]) * inv;
+    }
+    return result;
+  }
+
+  constexpr Dual operator-() const { return Scale(-value_, T(-1)); }
+
+  Dual Sin() const {
+    using std::cos;
+    using std::sin;
+    return Scale(sin(value_), cos(value_));
+  }
+
+  Dual Cos() const {
+    using std::cos;
+    using std::sin;
+    return Scale(cos(value_), -sin(value_));
+  }
+
+  Dual Log() const {
+    using std::log;
+    return Scale(log(value_), T(1) / value_);
+  }
+
+  Dual Exp() const {
+    using std::exp;
+    const T exp_value = exp(value_);
+    return Scale(exp_value, exp_value);
+  }
+
+  Dual& operator+=(const Dual& rhs) { return *this = *this + rhs; }
+  Dual& operator-=(const Dual& rhs) { return *this = *this - rhs; }
+  Dual& operator*=(const Dual& rhs) { return *this = *this * rhs; }
+  Dual& operator/=(const Dual& rhs) { return *this = *this / rhs; }
+
+ private:
+  // 一元运算的链式法则：f(x)的方向导数为f'(x) * x'
+  constexpr Dual Scale(const T& value, const T& derivative) const {
+    Dual result(value);
+    for (std::size_t i = 0; i < N; ++i) {
+      result.tangents_[i] = derivative * tangents_[i];
+    }
+    return result;
+  }
+
+  T value_;
+  Tangents tangents_;
+};
+
+// 常量在左侧的混合运算
+template <typename T, std::size_t N>
+constexpr Dual<T, N> operator+(const T& lhs, const Dual<T, N>& rhs) {
+  return Dual<T, N>(lhs) + rhs;
+}
+
+template <typename T, std::size_t N>
+constexpr Dual<T, N> operator-(const T& lhs, const Dual<T, N>& rhs) {
+  return Dual<T, N>(lhs) - rhs;
+}
+
+template <typename T, std::size_t N>
+constexpr Dual<T, N> operator*(const T& lhs, const Dual<T, N>& rhs) {
+  return Dual<T, N>(lhs) * rhs;
+}
+
+template <typename T, std::size_t N>
+constexpr Dual<T, N> operator/(const T& lhs, const Dual<T, N>& rhs) {
+  return Dual<T, N>(lhs) / rhs;
+}
+
+// 与std::sin等同名的自由函数，泛型代码中using std::sin后通过ADL找到，
+// 这也使得Dual<Dual<T>>可以正常工作
+template <typename T, std::size_t N>
+Dual<T, N> sin(const Dual<T, N>& x) {
+  return x.Sin();
+}
+
+template <typename T, std::size_t N>
+Dual<T, N> cos(const Dual<T, N>& x) {
+  return x.Cos();
+}
+
+template <typename T, std::size_t N>
+Dual<T, N> log(const Dual<T, N>& x) {
+  return x.Log();
+}
+
+template <typename T, std::size_t N>
+Dual<T, N> exp(const Dual<T, N>& x) {
+  return x.Exp();
+}
+
+}  // namespace ad
+
+#endif  // EXAMPLES_AUTODIFF_DUAL_H_
@@ -0,0 +1,119 @@
+#ifndef EXAMPLES_AUTODIFF_HESSIAN_H_
+#define EXAMPLES_AUTODIFF_HESSIAN_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "autodiff.h"
+#include "compiled_graph.h"
+#include "dual.h"
+
+namespace ad {
+
+// 目标函数，输入为与x对应的叶子，返回标量的root
+using Objective = std::function<Variable(const std::vector<Variable>&)>;
+
+namespace {
+// 用x建图并编译，返回每个输入在编译结果中的叶子编号
+CompiledGraph CompileObjective(const Objective& f, const std::vector<float>& x,
+                               std::vector<std::size_t>* slots) {
+  std::vector<Variable> leaves;
+  for (float value : x) {
+    leaves.emplace_back(value);
+  }
+  CompiledGraph graph = f(leaves).Compile();
+  *slots = graph.LeafIndices(leaves);
+  return graph;
+}
+
+// 叶子的值为编译时的值，输入的切向量由set_tangent(i, value)设置
+template <std::size_t N, typename SetTangent>
+std::vector<Dual<float, N>> DualLeaves(const CompiledGraph& graph,
+                                       const std::vector<std::size_t>& slots,
+                                       SetTangent set_tangent) {
+  std::vector<Dual<float, N>> values;
+  for (std::size_t i = 0; i < graph.NumLeaves(); ++i) {
+    values.emplace_back(graph.LeafValue(i));
+  }
+  for (std::size_t i = 0; i < slots.size(); ++i) {
+    if (slots[i] < graph.NumLeaves()) {
+      set_tangent(i, values[slots[i]]);
+    }
+  }
+  return values;
+}
+}  // namespace
+
+/*
+ * \brief Hessian与向量的乘积H(x) * v，采用forward-over-reverse：
+ * 计算图只构建并编译一次，然后以Dual<float>为标量做一次前向和反向传播，
+ * 输入的切向量为v，梯度的切向量即为H * v。代价约为一次梯度计算的常数倍，
+ * 不需要对符号模式的伴随值计算图再次反向传播，也没有有限差分的截断误差。
+ *
+ * \note f中创建的其他叶子被当作常数；与root无关的输入，结果为0。
+ * x与v的长度不同时抛出std::invalid_argument。
+ */
+std::vector<float> Hvp(const Objective& f, const std::vector<float>& x,
+                       const std::vector<float>& v) {
+  if (x.size() != v.size()) {
+    throw std::invalid_argument("x and v must have the same size");
+  }
+  std::vector<std::size_t> slots;
+  const CompiledGraph graph = CompileObjective(f, x, &slots);
+  std::vector<Dual<float>> values = DualLeaves<1>(
+      graph, slots, [&v](std::size_t i, Dual<float>& leaf) {
+        leaf = Dual<float>(leaf.Value(), {v[i]});
+      });
+  std::vector<Dual<float>> adjoints;
+  graph.Evaluate(values, adjoints);
+  std::vector<float> result(x.size(), .0F);
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    if (slots[i] < graph.NumLeaves()) {
+      result[i] = adjoints[slots[i]].Tangent();
+    }
+  }
+  return result;
+}
+
+/*
+ * \brief 完整的Hessian矩阵，result[i][j]为对x_i和x_j的二阶偏导数。
+ * 每次forward-over-reverse使用kLanes个方向，同时得到Hessian的kLanes列，
+ * n个输入只需要ceil(n / kLanes)次遍历。
+ */
+std::vector<std::vector<float>> Hessian(const Objective& f,
+                                        const std::vector<float>& x) {
+  constexpr std::size_t kLanes = 8;
+  using LaneDual = Dual<float, kLanes>;
+  std::vector<std::size_t> slots;
+  const CompiledGraph graph = CompileObjective(f, x, &slots);
+  std::vector<std::vector<float>> result(x.size(),
+                                         std::vector<float>(x.size(), .0F));
+  std::vector<LaneDual> adjoints;
+  for (std::size_t begin = 0; begin < x.size(); begin += kLanes) {
+    const std::size_t end = std::min(begin + kLanes, x.size());
+    // 第begin + l个输入的切向量是第l个方向上的单位向量
+    std::vector<LaneDual> values = DualLeaves<kLanes>(
+        graph, slots, [begin, end](std::size_t i, LaneDual& leaf) {
+          if (i >= begin && i < end) {
+            leaf = LaneDual::Input(leaf.Value(), i - begin);
+          }
+        });
+    graph.Evaluate(values, adjoints);
+    for (std::size_t i = 0; i < x.size(); ++i) {
+      if (slots[i] == graph.NumLeaves()) {
+        continue;
+      }
+      for (std::size_t j = begin; j < end; ++j) {
+        result[i][j] = adjoints[slots[i]].Tangent(j - begin);
+      }
+    }
+  }
+  return result;
+}
+
+}  // namespace ad
+
+#endif  // EXAMPLES_AUTODIFF_HESSIAN_H_
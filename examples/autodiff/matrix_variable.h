@@ -0,0 +1,535 @@
+#ifndef EXAMPLES_AUTODIFF_MATRIX_VARIABLE_H_
+#define EXAMPLES_AUTODIFF_MATRIX_VARIABLE_H_
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "autodiff.h"
+#include "matrix/matrix.h"
+
+namespace ad {
+class MatrixOpBase;
+class MatrixVariableImpl;
+
+/*
+ * \brief MatrixVariable是以Matrix<float>为值的Variable，
+ * 一个结点表示一整个矩阵。全连接层y = relu(x * W + b)只需要3个结点，
+ * 计算图的大小随层数增长，与参数的个数无关，矩阵运算在op的kernel中一次完成。
+ *
+ * \note 与BatchVariable相同，MatrixVariable只支持一阶导数，
+ * 反向传播时root的伴随值为全1矩阵，即对root的所有元素之和求导。
+ * 形状不匹配时抛出std::invalid_argument。
+ */
+class MatrixVariable {
+ public:
+  MatrixVariable() = default;
+
+  explicit MatrixVariable(Matrix<float> value);
+
+  // 矩阵乘法，要求Cols() == rhs.Rows()
+  MatrixVariable MatMul(const MatrixVariable& rhs) const;
+  // rhs与当前矩阵形状相同，或者只有一行，此时把它加到每一行上（如偏置）
+  MatrixVariable operator+(const MatrixVariable& rhs) const;
+  MatrixVariable ReLU() const;
+  // 所有元素之和，结果为1x1的矩阵
+  MatrixVariable Sum() const;
+  // 对每一行分别做softmax
+  MatrixVariable Softmax() const;
+
+  explicit operator bool() { return variable_ != nullptr; }
+
+  const Matrix<float>& Value();
+
+  const Matrix<float>& Value() const;
+
+  int Rows() const;
+
+  int Cols() const;
+
+  std::string Name() const;
+
+  std::size_t NumInputs() const;
+
+  const MatrixVariable& Inputs(std::size_t i) const;
+
+  const MatrixOpBase* Op() const;
+
+  // 中间结点的伴随值只在本次反向传播中有效，
+  // 叶子结点的伴随值会一直累加，直到调用ZeroGradient
+  void Backpropagation();
+
+  const Matrix<float>& GetAdjoint() const;
+
+  bool operator==(const MatrixVariable& rhs) {
+    return rhs.variable_ == variable_;
+  }
+
+  static void ZeroGradient();
+  static void ClearAllVirablesInPool();
+
+ private:
+  friend MatrixVariableImpl;
+
+  MatrixVariable(MatrixVariableImpl* var);
+
+  MatrixVariable NewNode(const MatrixOpBase* op, int rows, int cols) const;
+  MatrixVariable NewNode(const MatrixOpBase* op, const MatrixVariable& rhs,
+                         int rows, int cols) const;
+
+  static void Forward(const std::vector<MatrixVariableImpl*>& sorted_vec);
+
+ private:
+  MatrixVariableImpl* variable_ = nullptr;
+};
+
+/*
+ * \brief 矩阵op的基类，与OpBase一样是无状态的，通过GetOp获取共享的实例。
+ * Compute把结果写入已经分配好形状的output，
+ * Gradient把各个输入的伴随值累加到input_adjoints[i]中。
+ */
+class MatrixOpBase {
+ public:
+  explicit MatrixOpBase(const char* name) : op_name_(name) {}
+  virtual void Compute(const Matrix<float>* const* inputs,
+                       Matrix<float>& output) const = 0;
+  virtual void Gradient(const Matrix<float>* const* inputs,
+                        const Matrix<float>& output,
+                        const Matrix<float>& out_adjoint,
+                        Matrix<float>* const* input_adjoints) const = 0;
+  std::string GetName() const { return op_name_; }
+  virtual ~MatrixOpBase() = default;
+
+ private:
+  std::string op_name_;
+};
+
+class MatMulOp : public MatrixOpBase {
+  using MatrixOpBase::MatrixOpBase;
+
+ public:
+  void Compute(const Matrix<float>* const* inputs,
+               Matrix<float>& output) const final;
+  void Gradient(const Matrix<float>* const* inputs,
+                const Matrix<float>& output, const Matrix<float>& out_adjoint,
+                Matrix<float>* const* input_adjoints) const final;
+};
+
+class MatrixAddOp : public MatrixOpBase {
+  using MatrixOpBase::MatrixOpBase;
+
+ public:
+  void Compute(const Matrix<float>* const* inputs,
+               Matrix<float>& output) const final;
+  void Gradient(const Matrix<float>* const* inputs,
+                const Matrix<float>& output, const Matrix<float>& out_adjoint,
+                Matrix<float>* const* input_adjoints) const final;
+};
+
+class ReLUOp : public MatrixOpBase {
+  using MatrixOpBase::MatrixOpBase;
+
+ public:
+  void Compute(const Matrix<float>* const* inputs,
+               Matrix<float>& output) const final;
+  void Gradient(const Matrix<float>* const* inputs,
+                const Matrix<float>& output, const Matrix<float>& out_adjoint,
+                Matrix<float>* const* input_adjoints) const final;
+};
+
+class SumOp : public MatrixOpBase {
+  using MatrixOpBase::MatrixOpBase;
+
+ public:
+  void Compute(const Matrix<float>* const* inputs,
+               Matrix<float>& output) const final;
+  void Gradient(const Matrix<float>* const* inputs,
+                const Matrix<float>& output, const Matrix<float>& out_adjoint,
+                Matrix<float>* const* input_adjoints) const final;
+};
+
+class SoftmaxOp : public MatrixOpBase {
+  using MatrixOpBase::MatrixOpBase;
+
+ public:
+  void Compute(const Matrix<float>* const* inputs,
+               Matrix<float>& output) const final;
+  void Gradient(const Matrix<float>* const* inputs,
+                const Matrix<float>& output, const Matrix<float>& out_adjoint,
+                Matrix<float>* const* input_adjoints) const final;
+};
+
+class MatrixVariableImpl {
+  friend MatrixVariable;
+  friend BasicTape<MatrixVariableImpl>;
+
+ public:
+  MatrixVariableImpl(const MatrixVariableImpl&) = delete;
+  MatrixVariableImpl& operator=(const MatrixVariableImpl&) = delete;
+
+  // 与VariableImpl相同，每个线程有自己的Tape
+  static thread_local BasicTape<MatrixVariableImpl> tape_;
+
+ private:
+  MatrixVariableImpl(std::size_t index, int rows, int cols)
+      : index_(index), rows_(rows), cols_(cols) {}
+
+  void Reinit(std::size_t index, int rows, int cols) {
+    inputs_.clear();
+    op_ = nullptr;
+    value_ = Matrix<float>();
+    adjoint_ = Matrix<float>();
+    visit_mark_ = 0;
+    index_ = index;
+    rows_ = rows;
+    cols_ = cols;
+  }
+
+  std::size_t NumInputs() const { return inputs_.size(); }
+
+  MatrixVariableImpl* InputNode(std::size_t i) const {
+    return inputs_[i].variable_;
+  }
+
+  std::vector<MatrixVariable> inputs_;
+  const MatrixOpBase* op_ = nullptr;
+  // 值和伴随值在第一次使用时才分配，没有分配时为0x0的矩阵
+  Matrix<float> value_;
+  Matrix<float> adjoint_;
+  std::size_t index_;
+  int rows_;
+  int cols_;
+  std::size_t visit_mark_ = 0;
+};
+
+thread_local BasicTape<MatrixVariableImpl> MatrixVariableImpl::tape_;
+
+MatrixVariable::MatrixVariable(MatrixVariableImpl* var) : variable_(var) {}
+
+MatrixVariable::MatrixVariable(Matrix<float> value) {
+  if (value.Rows() <= 0 || value.Cols() <= 0) {
+    throw std::invalid_argument("matrix must not be empty");
+  }
+  variable_ = MatrixVariableImpl::tape_.NewVariable(value.Rows(), value.Cols());
+  variable_->value_ = std::move(value);
+}
+
+MatrixVariable MatrixVariable::NewNode(const MatrixOpBase* op, int rows,
+                                       int cols) const {
+  auto var_ref =
+      MatrixVariable{MatrixVariableImpl::tape_.NewVariable(rows, cols)};
+  var_ref.variable_->op_ = op;
+  var_ref.variable_->inputs_.emplace_back(*this);
+  return var_ref;
+}
+
+MatrixVariable MatrixVariable::NewNode(const MatrixOpBase* op,
+                                       const MatrixVariable& rhs, int rows,
+                                       int cols) const {
+  auto var_ref =
+      MatrixVariable{MatrixVariableImpl::tape_.NewVariable(rows, cols)};
+  var_ref.variable_->op_ = op;
+  var_ref.variable_->inputs_.emplace_back(*this);
+  var_ref.variable_->inputs_.emplace_back(rhs);
+  return var_ref;
+}
+
+namespace {
+std::string ShapeString(const MatrixVariable& var) {
+  return std::to_string(var.Rows()) + "x" + std::to_string(var.Cols());
+}
+}  // namespace
+
+MatrixVariable MatrixVariable::MatMul(const MatrixVariable& rhs) const {
+  if (Cols() != rhs.Rows()) {
+    throw std::invalid_argument("matmul shape mismatch: " + ShapeString(*this) +
+                                " vs " + ShapeString(rhs));
+  }
+  return NewNode(GetOp<MatMulOp>("matmul"), rhs, Rows(), rhs.Cols());
+}
+
+MatrixVariable MatrixVariable::operator+(const MatrixVariable& rhs) const {
+  if (Cols() != rhs.Cols() || (rhs.Rows() != Rows() && rhs.Rows() != 1)) {
+    throw std::invalid_argument("add shape mismatch: " + ShapeString(*this) +
+                                " vs " + ShapeString(rhs));
+  }
+  return NewNode(GetOp<MatrixAddOp>("add"), rhs, Rows(), Cols());
+}
+
+MatrixVariable MatrixVariable::ReLU() const {
+  return NewNode(GetOp<ReLUOp>("relu"), Rows(), Cols());
+}
+
+MatrixVariable MatrixVariable::Sum() const {
+  return NewNode(GetOp<SumOp>("sum"), 1, 1);
+}
+
+MatrixVariable MatrixVariable::Softmax() const {
+  return NewNode(GetOp<SoftmaxOp>("softmax"), Rows(), Cols());
+}
+
+void MatrixVariable::Forward(
+    const std::vector<MatrixVariableImpl*>& sorted_vec) {
+  for (auto iter = sorted_vec.rbegin(); iter != sorted_vec.rend(); ++iter) {
+    MatrixVariableImpl* var = *iter;
+    if (var->op_ == nullptr) {
+      continue;
+    }
+    const Matrix<float>* input_values[2];
+    for (std::size_t j = 0; j < var->NumInputs(); ++j) {
+      input_values[j] = &var->InputNode(j)->value_;
+    }
+    if (var->value_.Rows() == 0) {
+      var->value_ = Matrix<float>(var->rows_, var->cols_);
+    }
+    var->op_->Compute(input_values, var->value_);
+  }
+}
+
+void MatrixVariable::Backpropagation() {
+  std::vector<MatrixVariableImpl*> sorted_vec =
+      MatrixVariableImpl::tape_.TopoSort(variable_);
+  Forward(sorted_vec);
+  for (MatrixVariableImpl* var : sorted_vec) {
+    if (var->op_ || var->adjoint_.Rows() == 0) {
+      var->adjoint_ = Matrix<float>(var->rows_, var->cols_);
+    }
+  }
+  float* root_adjoint = variable_->adjoint_.Data();
+  for (int i = 0; i < variable_->rows_ * variable_->cols_; ++i) {
+    root_adjoint[i] += 1.0F;
+  }
+
+  for (MatrixVariableImpl* var : sorted_vec) {
+    if (var->op_ == nullptr) {
+      continue;
+    }
+    const Matrix<float>* input_values[2];
+    Matrix<float>* input_adjoints[2];
+    for (std::size_t j = 0; j < var->NumInputs(); ++j) {
+      input_values[j] = &var->InputNode(j)->value_;
+      input_adjoints[j] = &var->InputNode(j)->adjoint_;
+    }
+    var->op_->Gradient(input_values, var->value_, var->adjoint_,
+                       input_adjoints);
+  }
+}
+
+const Matrix<float>& MatrixVariable::Value() {
+  if (variable_->op_) {
+    Forward(MatrixVariableImpl::tape_.TopoSort(variable_));
+  }
+  return variable_->value_;
+}
+
+const Matrix<float>& MatrixVariable::Value() const { return variable_->value_; }
+
+int MatrixVariable::Rows() const { return variable_->rows_; }
+
+int MatrixVariable::Cols() const { return variable_->cols_; }
+
+std::string MatrixVariable::Name() const {
+  return "m" + std::to_string(variable_->index_);
+}
+
+std::size_t MatrixVariable::NumInputs() const {
+  return variable_->inputs_.size();
+}
+
+const MatrixVariable& MatrixVariable::Inputs(std::size_t i) const {
+  return variable_->inputs_[i];
+}
+
+const MatrixOpBase* MatrixVariable::Op() const { return variable_->op_; }
+
+const Matrix<float>& MatrixVariable::GetAdjoint() const {
+  if (variable_->adjoint_.Rows() == 0) {
+    throw std::invalid_argument("Run backward before get adjoint");
+  }
+  return variable_->adjoint_;
+}
+
+void MatrixVariable::ZeroGradient() {
+  for (std::size_t i = 0; i < MatrixVariableImpl::tape_.Size(); ++i) {
+    MatrixVariableImpl::tape_.At(i)->adjoint_ = Matrix<float>();
+  }
+}
+
+void MatrixVariable::ClearAllVirablesInPool() {
+  MatrixVariableImpl::tape_.Reset();
+}
+
+// C = A * B，按i-k-j的顺序遍历，内层循环对B和C的访问都是行连续的
+void MatMulOp::Compute(const Matrix<float>* const* inputs,
+                       Matrix<float>& output) const {
+  const Matrix<float>& a = *inputs[0];
+  const Matrix<float>& b = *inputs[1];
+  const int n = b.Cols();
+  float* c = output.Data();
+  std::fill(c, c + a.Rows() * n, .0F);
+  for (int i = 0; i < a.Rows(); ++i) {
+    for (int k = 0; k < a.Cols(); ++k) {
+      const float a_ik = a.At(i, k);
+      const float* b_row = b.Data() + k * n;
+      float* c_row = c + i * n;
+      for (int j = 0; j < n; ++j) {
+        c_row[j] += a_ik * b_row[j];
+      }
+    }
+  }
+}
+
+// dA += dC * B^T，dB += A^T * dC
+void MatMulOp::Gradient(const Matrix<float>* const* inputs,
+                        const Matrix<float>& output,
+                        const Matrix<float>& out_adjoint,
+                        Matrix<float>* const* input_adjoints) const {
+  UNUSED(output);
+  const Matrix<float>& a = *inputs[0];
+  const Matrix<float>& b = *inputs[1];
+  Matrix<float>& da = *input_adjoints[0];
+  Matrix<float>& db = *input_adjoints[1];
+  const int n = b.Cols();
+  for (int i = 0; i < a.Rows(); ++i) {
+    const float* dc_row = out_adjoint.Data() + i * n;
+    for (int k = 0; k < a.Cols(); ++k) {
+      const float* b_row = b.Data() + k * n;
+      float* db_row = db.Data() + k * n;
+      const float a_ik = a.At(i, k);
+      float dot = .0F;
+      for (int j = 0; j < n; ++j) {
+        dot += dc_row[j] * b_row[j];
+        db_row[j] += a_ik * dc_row[j];
+      }
+      da.At(i, k) += dot;
+    }
+  }
+}
+
+void MatrixAddOp::Compute(const Matrix<float>* const* inputs,
+                          Matrix<float>& output) const {
+  const Matrix<float>& a = *inputs[0];
+  const Matrix<float>& b = *inputs[1];
+  // b只有一行时，每一行都加上b的第0行
+  const int b_stride = b.Rows() == 1 ? 0 : b.Cols();
+  for (int i = 0; i < a.Rows(); ++i) {
+    const float* a_row = a.Data() + i * a.Cols();
+    const float* b_row = b.Data() + i * b_stride;
+    float* out_row = output.Data() + i * a.Cols();
+    for (int j = 0; j < a.Cols(); ++j) {
+      out_row[j] = a_row[j] + b_row[j];
+    }
+  }
+}
+
+// 被广播的输入，其伴随值为所有行的伴随值之和
+void MatrixAddOp::Gradient(const Matrix<float>* const* inputs,
+                           const Matrix<float>& output,
+                           const Matrix<float>& out_adjoint,
+                           Matrix<float>* const* input_adjoints) const {
+  UNUSED(output);
+  const Matrix<float>& b = *inputs[1];
+  Matrix<float>& da = *input_adjoints[0];
+  Matrix<float>& db = *input_adjoints[1];
+  const int b_stride = b.Rows() == 1 ? 0 : b.Cols();
+  for (int i = 0; i < out_adjoint.Rows(); ++i) {
+    const float* g_row = out_adjoint.Data() + i * out_adjoint.Cols();
+    float* da_row = da.Data() + i * out_adjoint.Cols();
+    float* db_row = db.Data() + i * b_stride;
+    for (int j = 0; j < out_adjoint.Cols(); ++j) {
+      da_row[j] += g_row[j];
+      db_row[j] += g_row[j];
+    }
+  }
+}
+
+void ReLUOp::Compute(const Matrix<float>* const* inputs,
+                     Matrix<float>& output) const {
+  const float* x = inputs[0]->Data();
+  float* y = output.Data();
+  for (int i = 0; i < output.Rows() * output.Cols(); ++i) {
+    y[i] = std::max(x[i], .0F);
+  }
+}
+
+void ReLUOp::Gradient(const Matrix<float>* const* inputs,
+                      const Matrix<float>& output,
+                      const Matrix<float>& out_adjoint,
+                      Matrix<float>* const* input_adjoints) const {
+  UNUSED(output);
+  const float* x = inputs[0]->Data();
+  const float* g = out_adjoint.Data();
+  float* dx = input_adjoints[0]->Data();
+  for (int i = 0; i < out_adjoint.Rows() * out_adjoint.Cols(); ++i) {
+    dx[i] += x[i] > .0F ? g[i] : .0F;
+  }
+}
+
+void SumOp::Compute(const Matrix<float>* const* inputs,
+                    Matrix<float>& output) const {
+  const Matrix<float>& x = *inputs[0];
+  output.At(0, 0) =
+      std::accumulate(x.Data(), x.Data() + x.Rows() * x.Cols(), .0F);
+}
+
+void SumOp::Gradient(const Matrix<float>* const* inputs,
+                     const Matrix<float>& output,
+                     const Matrix<float>& out_adjoint,
+                     Matrix<float>* const* input_adjoints) const {
+  UNUSED(output);
+  const Matrix<float>& x = *inputs[0];
+  const float g = out_adjoint.At(0, 0);
+  float* dx = input_adjoints[0]->Data();
+  for (int i = 0; i < x.Rows() * x.Cols(); ++i) {
+    dx[i] += g;
+  }
+}
+
+// 先减去每行的最大值再求exp，避免上溢
+void SoftmaxOp::Compute(const Matrix<float>* const* inputs,
+                        Matrix<float>& output) const {
+  const Matrix<float>& x = *inputs[0];
+  const int n = x.Cols();
+  for (int i = 0; i < x.Rows(); ++i) {
+    const float* x_row = x.Data() + i * n;
+    float* y_row = output.Data() + i * n;
+    const float max_value = *std::max_element(x_row, x_row + n);
+    float sum = .0F;
+    for (int j = 0; j < n; ++j) {
+      y_row[j] = std::exp(x_row[j] - max_value);
+      sum += y_row[j];
+    }
+    for (int j = 0; j < n; ++j) {
+      y_row[j] /= sum;
+    }
+  }
+}
+
+// dx_j = y_j * (g_j - sum_k(g_k * y_k))
+void SoftmaxOp::Gradient(const Matrix<float>* const* inputs,
+                         const Matrix<float>& output,
+                         const Matrix<float>& out_adjoint,
+                         Matrix<float>* const* input_adjoints) const {
+  UNUSED(inputs);
+  const int n = output.Cols();
+  for (int i = 0; i < output.Rows(); ++i) {
+    const float* y_row = output.Data() + i * n;
+    const float* g_row = out_adjoint.Data() + i * n;
+    float* dx_row = input_adjoints[0]->Data() + i * n;
+    float dot = .0F;
+    for (int j = 0; j < n; ++j) {
+      dot += g_row[j] * y_row[j];
+    }
+    for (int j = 0; j < n; ++j) {
+      dx_row[j] += y_row[j] * (g_row[j] - dot);
+    }
+  }
+}
+
+}  // namespace ad
+
+#endif  // EXAMPLES_AUTODIFF_MATRIX_VARIABLE_H_
@@ -0,0 +1,58 @@
+#ifndef EXAMPLES_AUTODIFF_ROSENBROCK_H_
+#define EXAMPLES_AUTODIFF_ROSENBROCK_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "autodiff.h"
+
+/*
+ * \brief 扩展的Rosenbrock函数
+ * sum(100 * (x_{i+1} - x_i^2)^2 + (1 - x_i)^2)，以及它的解析二阶导数，
+ * autodiff_test和autodiff_benchmark都用它检查Hvp和Hessian的结果。
+ */
+namespace ad {
+
+inline Variable Rosenbrock(const std::vector<Variable>& x) {
+  auto hundred = Variable::Constant(100);
+  auto one = Variable::Constant(1);
+  auto sum = Variable::Constant(0);
+  for (std::size_t i = 0; i + 1 < x.size(); ++i) {
+    auto a = x[i + 1] - x[i] * x[i];
+    auto b = one - x[i];
+    sum = sum + hundred * a * a + b * b;
+  }
+  return sum;
+}
+
+// Hessian是三对角矩阵，按double精度计算
+inline std::vector<std::vector<double>> RosenbrockHessian(
+    const std::vector<float>& x) {
+  const std::size_t n = x.size();
+  std::vector<std::vector<double>> h(n, std::vector<double>(n, 0.0));
+  for (std::size_t i = 0; i + 1 < n; ++i) {
+    const double xi = x[i];
+    h[i][i] += 1200 * xi * xi - 400.0 * x[i + 1] + 2;
+    h[i + 1][i + 1] += 200;
+    h[i][i + 1] = h[i + 1][i] = -400 * xi;
+  }
+  return h;
+}
+
+// Hessian与向量v的乘积，不构造完整的矩阵，O(n)
+inline std::vector<double> RosenbrockHvp(const std::vector<float>& x,
+                                         const std::vector<float>& v) {
+  const std::size_t n = x.size();
+  std::vector<double> hv(n, 0.0);
+  for (std::size_t i = 0; i + 1 < n; ++i) {
+    const double xi = x[i];
+    hv[i] += (1200 * xi * xi - 400.0 * x[i + 1] + 2) * v[i] -
+             400 * xi * v[i + 1];
+    hv[i + 1] += 200.0 * v[i + 1] - 400 * xi * v[i];
+  }
+  return hv;
+}
+
+}  // namespace ad
+
+#endif  // EXAMPLES_AUTODIFF_ROSENBROCK_H_
@@ -0,0 +1,487 @@
+#ifndef EXAMPLES_AUTODIFF_SIMD_MATH_H_
+#define EXAMPLES_AUTODIFF_SIMD_MATH_H_
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define AD_SIMD_X86 1
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+/*
+ * \brief float数组上的sin/cos/log/exp，使用Cephes的多项式逼近
+ * CPU支持AVX2和FMA时每次处理8个float，与gemm.h的微内核一样用target属性
+ * 单独编译并在运行时检测，不需要-mavx2等编译选项；其余情况以及数组末尾
+ * 不足8个的元素，使用同一套多项式的标量版本。
+ *
+ * 精度（与double版本的std函数比较，在autodiff_test中验证）：
+ *   Sin/Cos: |x| <= 8192时，绝对误差不超过2e-7；|x| > 8192、inf和NaN
+ *            超出了区间约化的范围，逐个元素改用std::sin/std::cos
+ *   Exp: 相对误差不超过2e-7；x < -87.33时返回0，x > 88.72时返回inf
+ *   Log: 误差不超过2e-7 * max(1, |log(x)|)；x == 0返回-inf，
+ *        x < 0返回NaN，非正规化数按FLT_MIN处理
+ */
+namespace ad {
+namespace simd {
+namespace internal {
+constexpr float kFourOverPi = 1.27323954473516F;
+// 超过此值时x * 4/pi转换为整数会溢出，kDp1等三段的舍入误差也不再可忽略
+constexpr float kReduceMax = 8192.0F;
+// pi/4 = kDp1 + kDp2 + kDp3，分成三段来减少区间约化时的舍入误差
+constexpr float kDp1 = 0.78515625F;
+constexpr float kDp2 = 2.4187564849853515625e-4F;
+constexpr float kDp3 = 3.77489497744594108e-8F;
+constexpr float kSinP0 = -1.9515295891E-4F;
+constexpr float kSinP1 = 8.3321608736E-3F;
+constexpr float kSinP2 = -1.6666654611E-1F;
+constexpr float kCosP0 = 2.443315711809948E-005F;
+constexpr float kCosP1 = -1.388731625493765E-003F;
+constexpr float kCosP2 = 4.166664568298827E-002F;
+
+constexpr float kExpLo = -87.33F;
+constexpr float kExpHi = 88.7228F;
+constexpr float kLog2e = 1.44269504088896341F;
+// ln2 = kLn2Hi + kLn2Lo
+constexpr float kLn2Hi = 0.693359375F;
+constexpr float kLn2Lo = -2.12194440e-4F;
+constexpr float kExpP0 = 1.9875691500E-4F;
+constexpr float kExpP1 = 1.3981999507E-3F;
+constexpr float kExpP2 = 8.3334519073E-3F;
+constexpr float kExpP3 = 4.1665795894E-2F;
+constexpr float kExpP4 = 1.6666665459E-1F;
+constexpr float kExpP5 = 5.0000001201E-1F;
+
+constexpr float kSqrtHalf = 0.707106781186547524F;
+constexpr float kLogP0 = 7.0376836292E-2F;
+constexpr float kLogP1 = -1.1514610310E-1F;
+constexpr float kLogP2 = 1.1676998740E-1F;
+constexpr float kLogP3 = -1.2420140846E-1F;
+constexpr float kLogP4 = 1.4249322787E-1F;
+constexpr float kLogP5 = -1.6668057665E-1F;
+constexpr float kLogP6 = 2.0000714765E-1F;
+constexpr float kLogP7 = -2.4999993993E-1F;
+constexpr float kLogP8 = 3.3333331174E-1F;
+
+inline std::uint32_t FloatBits(float x) {
+  std::uint32_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+inline float BitsFloat(std::uint32_t bits) {
+  float x;
+  std::memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+// 把|x|约化到[-pi/4, pi/4]，octant为|x|所在的pi/4区间编号（偶数），
+// 要求|x| <= kReduceMax
+inline float ReduceQuarterPi(float x, std::uint32_t* octant) {
+  auto j = static_cast<std::uint32_t>(x * kFourOverPi);
+  j = (j + 1) & ~1U;
+  auto y = static_cast<float>(j);
+  *octant = j;
+  return ((x - y * kDp1) - y * kDp2) - y * kDp3;
+}
+
+inline float SinPoly(float x, float z) {
+  return ((kSinP0 * z + kSinP1) * z + kSinP2) * z * x + x;
+}
+
+inline float CosPoly(float z) {
+  return ((kCosP0 * z + kCosP1) * z + kCosP2) * z * z - 0.5F * z + 1.0F;
+}
+
+inline float SinScalar(float x) {
+  if (!(std::abs(x) <= kReduceMax)) {
+    return std::sin(x);
+  }
+  std::uint32_t sign = FloatBits(x) & 0x80000000U;
+  std::uint32_t octant;
+  float r = ReduceQuarterPi(std::abs(x), &octant);
+  float z = r * r;
+  float y = (octant & 2) == 0 ? SinPoly(r, z) : CosPoly(z);
+  sign ^= (octant & 4) << 29;
+  return BitsFloat(FloatBits(y) ^ sign);
+}
+
+inline float CosScalar(float x) {
+  if (!(std::abs(x) <= kReduceMax)) {
+    return std::cos(x);
+  }
+  std::uint32_t octant;
+  float r = ReduceQuarterPi(std::abs(x), &octant);
+  octant -= 2;
+  float z = r * r;
+  float y = (octant & 2) == 0 ? SinPoly(r, z) : CosPoly(z);
+  std::uint32_t sign = (~octant & 4) << 29;
+  return BitsFloat(FloatBits(y) ^ sign);
+}
+
+inline float ExpScalar(float x) {
+  if (std::isnan(x)) {
+    return x;
+  }
+  if (x < kExpLo) {
+    return .0F;
+  }
+  if (x > kExpHi) {
+    return std::numeric_limits<float>::infinity();
+  }
+  float n = std::nearbyint(x * kLog2e);
+  float r = x - n * kLn2Hi - n * kLn2Lo;
+  float z = r * r;
+  float p =
+      (((((kExpP0 * r + kExpP1) * r + kExpP2) * r + kExpP3) * r + kExpP4) * r +
+       kExpP5) *
+          z +
+      r + 1.0F;
+  // p在[0.7, 1.5)之间，把n直接加到p的指数位上即为p * 2^n
+  auto scale = static_cast<std::uint32_t>(static_cast<std::int32_t>(n)) << 23;
+  return BitsFloat(FloatBits(p) + scale);
+}
+
+inline float LogPoly(float x) {
+  float y = kLogP0;
+  y = y * x + kLogP1;
+  y = y * x + kLogP2;
+  y = y * x + kLogP3;
+  y = y * x + kLogP4;
+  y = y * x + kLogP5;
+  y = y * x + kLogP6;
+  y = y * x + kLogP7;
+  y = y * x + kLogP8;
+  return y;
+}
+
+inline float LogScalar(float x) {
+  if (std::isnan(x) || x > std::numeric_limits<float>::max()) {
+    return x;
+  }
+  if (x < .0F) {
+    return std::numeric_limits<float>::quiet_NaN();
+  }
+  if (x <= .0F) {
+    return -std::numeric_limits<float>::infinity();
+  }
+  x = std::max(x, std::numeric_limits<float>::min());
+  std::uint32_t bits = FloatBits(x);
+  // x = m * 2^e，m在[0.5, 1)之间
+  auto e = static_cast<float>(static_cast<std::int32_t>(bits >> 23) - 126);
+  float m = BitsFloat((bits & 0x007FFFFFU) | 0x3F000000U);
+  if (m < kSqrtHalf) {
+    e -= 1.0F;
+    m = m + m - 1.0F;
+  } else {
+    m = m - 1.0F;
+  }
+  float z = m * m;
+  float y = LogPoly(m) * m * z;
+  y += e * kLn2Lo;
+  y -= 0.5F * z;
+  return m + y + e * kLn2Hi;
+}
+
+#ifdef AD_SIMD_X86
+__attribute__((target("avx2,fma"))) inline __m256 SinCosPoly(
+    __m256 r, __m256i octant) {
+  __m256 z = _mm256_mul_ps(r, r);
+  __m256 s = _mm256_fmadd_ps(_mm256_set1_ps(kSinP0), z,
+                             _mm256_set1_ps(kSinP1));
+  s = _mm256_fmadd_ps(s, z, _mm256_set1_ps(kSinP2));
+  s = _mm256_fmadd_ps(_mm256_mul_ps(s, z), r, r);
+  __m256 c = _mm256_fmadd_ps(_mm256_set1_ps(kCosP0), z,
+                             _mm256_set1_ps(kCosP1));
+  c = _mm256_fmadd_ps(c, z, _mm256_set1_ps(kCosP2));
+  c = _mm256_mul_ps(_mm256_mul_ps(c, z), z);
+  c = _mm256_fnmadd_ps(_mm256_set1_ps(0.5F), z, c);
+  c = _mm256_add_ps(c, _mm256_set1_ps(1.0F));
+  // (octant & 2) == 0时使用sin的多项式，否则使用cos的多项式
+  __m256i use_cos = _mm256_cmpeq_epi32(
+      _mm256_and_si256(octant, _mm256_set1_epi32(2)), _mm256_set1_epi32(2));
+  return _mm256_blendv_ps(s, c, _mm256_castsi256_ps(use_cos));
+}
+
+__attribute__((target("avx2,fma"))) inline __m256 ReduceQuarterPi(
+    __m256 x, __m256i* octant) {
+  __m256i j =
+      _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(kFourOverPi)));
+  j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)),
+                       _mm256_set1_epi32(~1));
+  __m256 y = _mm256_cvtepi32_ps(j);
+  *octant = j;
+  x = _mm256_fnmadd_ps(y, _mm256_set1_ps(kDp1), x);
+  x = _mm256_fnmadd_ps(y, _mm256_set1_ps(kDp2), x);
+  return _mm256_fnmadd_ps(y, _mm256_set1_ps(kDp3), x);
+}
+
+// |x| > kReduceMax或NaN的元素y[i]改为fn(x[i])，这类输入很少见，逐个处理
+template <typename Fn>
+__attribute__((target("avx2,fma"))) inline __m256 FixLargeArguments(
+    __m256 x, __m256 y, Fn fn) {
+  __m256 abs = _mm256_andnot_ps(_mm256_set1_ps(-.0F), x);
+  int large = _mm256_movemask_ps(
+      _mm256_cmp_ps(abs, _mm256_set1_ps(kReduceMax), _CMP_NLE_UQ));
+  if (large == 0) {
+    return y;
+  }
+  alignas(32) float xs[8];
+  alignas(32) float ys[8];
+  _mm256_store_ps(xs, x);
+  _mm256_store_ps(ys, y);
+  for (int i = 0; i < 8; ++i) {
+    if ((large >> i) & 1) {
+      ys[i] = fn(xs[i]);
+    }
+  }
+  return _mm256_load_ps(ys);
+}
+
+__attribute__((target("avx2,fma"))) inline __m256 Sin8(__m256 x) {
+  const __m256 sign_mask = _mm256_set1_ps(-.0F);
+  __m256 sign = _mm256_and_ps(x, sign_mask);
+  __m256i octant;
+  __m256 r = ReduceQuarterPi(_mm256_andnot_ps(sign_mask, x), &octant);
+  __m256 y = SinCosPoly(r, octant);
+  __m256i flip =
+      _mm256_slli_epi32(_mm256_and_si256(octant, _mm256_set1_epi32(4)), 29);
+  sign = _mm256_xor_ps(sign, _mm256_castsi256_ps(flip));
+  y = _mm256_xor_ps(y, sign);
+  return FixLargeArguments(x, y, [](float v) { return std::sin(v); });
+}
+
+__attribute__((target("avx2,fma"))) inline __m256 Cos8(__m256 x) {
+  __m256i octant;
+  __m256 r =
+      ReduceQuarterPi(_mm256_andnot_ps(_mm256_set1_ps(-.0F), x), &octant);
+  octant = _mm256_sub_epi32(octant, _mm256_set1_epi32(2));
+  __m256 y = SinCosPoly(r, octant);
+  __m256i flip = _mm256_slli_epi32(
+      _mm256_andnot_si256(octant, _mm256_set1_epi32(4)), 29);
+  y = _mm256_xor_ps(y, _mm256_castsi256_ps(flip));
+  return FixLargeArguments(x, y, [](float v) { return std::cos(v); });
+}
+
+__attribute__((target("avx2,fma"))) inline __m256 Exp8(__m256 x) {
+  __m256 lo = _mm256_set1_ps(kExpLo);
+  __m256 hi = _mm256_set1_ps(kExpHi);
+  __m256 underflow = _mm256_cmp_ps(x, lo, _CMP_LT_OQ);
+  __m256 overflow = _mm256_cmp_ps(x, hi, _CMP_GT_OQ);
+  // 把lo、hi放在第一个操作数，x为NaN时结果仍为NaN
+  __m256 c = _mm256_min_ps(hi, _mm256_max_ps(lo, x));
+  __m256 n = _mm256_round_ps(_mm256_mul_ps(c, _mm256_set1_ps(kLog2e)),
+                             _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(kLn2Hi), c);
+  r = _mm256_fnmadd_ps(n, _mm256_set1_ps(kLn2Lo), r);
+  __m256 z = _mm256_mul_ps(r, r);
+  __m256 p = _mm256_fmadd_ps(_mm256_set1_ps(kExpP0), r,
+                             _mm256_set1_ps(kExpP1));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kExpP2));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kExpP3));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kExpP4));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kExpP5));
+  p = _mm256_fmadd_ps(p, z, r);
+  p = _mm256_add_ps(p, _mm256_set1_ps(1.0F));
+  __m256i scale = _mm256_slli_epi32(_mm256_cvtps_epi32(n), 23);
+  __m256 y =
+      _mm256_castsi256_ps(_mm256_add_epi32(_mm256_castps_si256(p), scale));
+  y = _mm256_andnot_ps(underflow, y);
+  return _mm256_blendv_ps(
+      y, _mm256_set1_ps(std::numeric_limits<float>::infinity()), overflow);
+}
+
+__attribute__((target("avx2,fma"))) inline __m256 Log8(__m256 x) {
+  __m256 zero = _mm256_setzero_ps();
+  __m256 invalid = _mm256_cmp_ps(x, zero, _CMP_LT_OQ);
+  __m256 is_zero = _mm256_cmp_ps(x, zero, _CMP_EQ_OQ);
+  __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  __m256 passthrough = _mm256_or_ps(_mm256_cmp_ps(x, inf, _CMP_EQ_OQ),
+                                    _mm256_cmp_ps(x, x, _CMP_UNORD_Q));
+  __m256 v =
+      _mm256_max_ps(x, _mm256_set1_ps(std::numeric_limits<float>::min()));
+  __m256i bits = _mm256_castps_si256(v);
+  __m256 e = _mm256_cvtepi32_ps(
+      _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+  __m256 m = _mm256_castsi256_ps(
+      _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)),
+                      _mm256_set1_epi32(0x3F000000)));
+  // m < sqrt(0.5)时，m = 2m - 1，e = e - 1；否则m = m - 1
+  __m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(kSqrtHalf), _CMP_LT_OQ);
+  __m256 one = _mm256_set1_ps(1.0F);
+  e = _mm256_sub_ps(e, _mm256_and_ps(small, one));
+  m = _mm256_sub_ps(_mm256_add_ps(m, _mm256_and_ps(small, m)), one);
+  __m256 z = _mm256_mul_ps(m, m);
+  __m256 y = _mm256_set1_ps(kLogP0);
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(kLogP1));
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(kLogP2));
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(kLogP3));
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(kLogP4));
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(kLogP5));
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(kLogP6));
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(kLogP7));
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(kLogP8));
+  y = _mm256_mul_ps(_mm256_mul_ps(y, m), z);
+  y = _mm256_fmadd_ps(e, _mm256_set1_ps(kLn2Lo), y);
+  y = _mm256_fnmadd_ps(_mm256_set1_ps(0.5F), z, y);
+  y = _mm256_add_ps(_mm256_add_ps(m, y),
+                    _mm256_mul_ps(e, _mm256_set1_ps(kLn2Hi)));
+  y = _mm256_blendv_ps(y, x, passthrough);
+  y = _mm256_blendv_ps(
+      y, _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN()), invalid);
+  return _mm256_blendv_ps(y, _mm256_sub_ps(zero, inf), is_zero);
+}
+#endif  // AD_SIMD_X86
+
+// Fn::Scalar和Fn::Vector分别为函数的标量版本和8路版本
+struct SinFn {
+  static float Scalar(float x) { return SinScalar(x); }
+#ifdef AD_SIMD_X86
+  __attribute__((target("avx2,fma"))) static __m256 Vector(__m256 x) {
+    return Sin8(x);
+  }
+#endif
+};
+
+struct CosFn {
+  static float Scalar(float x) { return CosScalar(x); }
+#ifdef AD_SIMD_X86
+  __attribute__((target("avx2,fma"))) static __m256 Vector(__m256 x) {
+    return Cos8(x);
+  }
+#endif
+};
+
+struct ExpFn {
+  static float Scalar(float x) { return ExpScalar(x); }
+#ifdef AD_SIMD_X86
+  __attribute__((target("avx2,fma"))) static __m256 Vector(__m256 x) {
+    return Exp8(x);
+  }
+#endif
+};
+
+struct LogFn {
+  static float Scalar(float x) { return LogScalar(x); }
+#ifdef AD_SIMD_X86
+  __attribute__((target("avx2,fma"))) static __m256 Vector(__m256 x) {
+    return Log8(x);
+  }
+#endif
+};
+
+// y[i] = f(x[i])，从下标begin开始使用标量版本
+template <typename Fn>
+inline void MapScalar(const float* x, float* y, std::size_t begin,
+                      std::size_t n) {
+  for (std::size_t i = begin; i < n; ++i) {
+    y[i] = Fn::Scalar(x[i]);
+  }
+}
+
+// Negate为false时out[i] += scale[i] * f(x[i])，
+// 否则out[i] -= scale[i] * f(x[i])，从下标begin开始使用标量版本
+template <bool Negate, typename Fn>
+inline void MapAccumulateScalar(const float* x, const float* scale, float* out,
+                                std::size_t begin, std::size_t n) {
+  for (std::size_t i = begin; i < n; ++i) {
+    if (Negate) {
+      out[i] -= scale[i] * Fn::Scalar(x[i]);
+    } else {
+      out[i] += scale[i] * Fn::Scalar(x[i]);
+    }
+  }
+}
+
+#ifdef AD_SIMD_X86
+// 第一次调用时检测CPU
+inline bool HasAvx2() {
+  static const bool has_avx2 =
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  return has_avx2;
+}
+
+template <typename Fn>
+__attribute__((target("avx2,fma"))) void MapAvx2(const float* x, float* y,
+                                                 std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(y + i, Fn::Vector(_mm256_loadu_ps(x + i)));
+  }
+  MapScalar<Fn>(x, y, i, n);
+}
+
+template <bool Negate, typename Fn>
+__attribute__((target("avx2,fma"))) void MapAccumulateAvx2(
+    const float* x, const float* scale, float* out, std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 fx = Fn::Vector(_mm256_loadu_ps(x + i));
+    __m256 s = _mm256_loadu_ps(scale + i);
+    __m256 o = _mm256_loadu_ps(out + i);
+    o = Negate ? _mm256_fnmadd_ps(s, fx, o) : _mm256_fmadd_ps(s, fx, o);
+    _mm256_storeu_ps(out + i, o);
+  }
+  MapAccumulateScalar<Negate, Fn>(x, scale, out, i, n);
+}
+#endif  // AD_SIMD_X86
+
+template <typename Fn>
+inline void Map(const float* x, float* y, std::size_t n) {
+#ifdef AD_SIMD_X86
+  if (HasAvx2()) {
+    MapAvx2<Fn>(x, y, n);
+    return;
+  }
+#endif
+  MapScalar<Fn>(x, y, 0, n);
+}
+
+template <bool Negate, typename Fn>
+inline void MapAccumulate(const float* x, const float* scale, float* out,
+                          std::size_t n) {
+#ifdef AD_SIMD_X86
+  if (HasAvx2()) {
+    MapAccumulateAvx2<Negate, Fn>(x, scale, out, n);
+    return;
+  }
+#endif
+  MapAccumulateScalar<Negate, Fn>(x, scale, out, 0, n);
+}
+}  // namespace internal
+
+inline void Sin(const float* x, float* y, std::size_t n) {
+  internal::Map<internal::SinFn>(x, y, n);
+}
+
+inline void Cos(const float* x, float* y, std::size_t n) {
+  internal::Map<internal::CosFn>(x, y, n);
+}
+
+inline void Exp(const float* x, float* y, std::size_t n) {
+  internal::Map<internal::ExpFn>(x, y, n);
+}
+
+inline void Log(const float* x, float* y, std::size_t n) {
+  internal::Map<internal::LogFn>(x, y, n);
+}
+
+// out[i] += scale[i] * cos(x[i])，即sin(x)的梯度
+inline void AccumulateCos(const float* x, const float* scale, float* out,
+                          std::size_t n) {
+  internal::MapAccumulate<false, internal::CosFn>(x, scale, out, n);
+}
+
+// out[i] -= scale[i] * sin(x[i])，即cos(x)的梯度
+inline void AccumulateNegSin(const float* x, const float* scale, float* out,
+                             std::size_t n) {
+  internal::MapAccumulate<true, internal::SinFn>(x, scale, out, n);
+}
+}  // namespace simd
+}  // namespace ad
+
+#endif  // EXAMPLES_AUTODIFF_SIMD_MATH_H_
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "matrix/batched.h"
+#include "matrix/gemm.h"
+#include "matrix/thread_pool.h"
+
+// 大量同形状小方阵的乘法：逐个调用Gemm与BatchedMatMul的各个内核比较。
+// 用法: matmul_batched
+//
+// 每种尺寸的batch使A、B、C合计约48MB，不能全部放在缓存中。
+// 误差为与逐个调用Gemm的结果的最大绝对差。
+
+namespace {
+
+constexpr std::size_t kBytes = 48 << 20;
+
+// 取3次中最快的一次，单位为毫秒
+template <typename F>
+double Time(F run) {
+  run();  // 预热
+  double best = 1e30;
+  for (int rep = 0; rep < 3; ++rep) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+void Report(int size, int batch, const std::string& name, double ms,
+            double baseline_ms, double error) {
+  std::cout << std::setw(5) << size << std::setw(9) << batch << std::setw(14)
+            << name << std::setw(10) << std::fixed << std::setprecision(2)
+            << ms << std::setw(12) << std::setprecision(1)
+            << ms * 1e6 / batch << std::setw(10)
+            << 2.0 * size * size * size * batch / (ms * 1e6) << std::setw(9)
+            << baseline_ms / ms << "x" << std::setw(11) << std::scientific
+            << std::setprecision(1) << error << std::endl;
+}
+
+template <int S>
+void RunSize(gemm::ThreadPool* pool) {
+  const int batch = static_cast<int>(kBytes / (3 * S * S * sizeof(float)));
+  const std::size_t elements = static_cast<std::size_t>(batch) * S * S;
+  std::mt19937 gen(S);
+  std::normal_distribution<float> dist(0, 1);
+  std::vector<float> a(elements);
+  std::vector<float> b(elements);
+  for (std::size_t i = 0; i < elements; ++i) {
+    a[i] = dist(gen);
+    b[i] = dist(gen);
+  }
+  std::vector<float> expected(elements);
+  const double gemm_ms = Time([&]() {
+    for (std::size_t i = 0; i < elements; i += S * S) {
+      gemm::Gemm(S, S, S, 1.0F, a.data() + i, S, b.data() + i, S, 0.0F,
+                 expected.data() + i, S);
+    }
+  });
+  Report(S, batch, "Gemm", gemm_ms, gemm_ms, 0);
+
+  std::vector<float> c(elements);
+  auto max_error = [&]() {
+    double error = 0;
+    for (std::size_t i = 0; i < elements; ++i) {
+      error = std::max(error, static_cast<double>(std::abs(c[i] -
+                                                           expected[i])));
+    }
+    return error;
+  };
+  for (const auto& kernel : gemm::AvailableBatchedKernels<S, S, S, float>()) {
+    const double ms = Time([&]() {
+      gemm::BatchedMatMul<S, S, S>(kernel, batch, a.data(), b.data(),
+                                   c.data());
+    });
+    Report(S, batch, kernel.name, ms, gemm_ms, max_error());
+  }
+  if (pool != nullptr) {
+    const double ms = Time([&]() {
+      gemm::BatchedMatMul<S, S, S>(batch, a.data(), b.data(), c.data(),
+                                   pool);
+    });
+    Report(S, batch, std::to_string(pool->NumThreads()) + " threads", ms,
+           gemm_ms, max_error());
+  }
+}
+
+}  // namespace
+
+int main() {
+  const int cores = static_cast<int>(std::thread::hardware_concurrency());
+  std::unique_ptr<gemm::ThreadPool> pool;
+  if (cores > 1) {
+    pool = std::make_unique<gemm::ThreadPool>(cores);
+  }
+  std::cout << std::setw(5) << "size" << std::setw(9) << "batch"
+            << std::setw(14) << "variant" << std::setw(10) << "ms"
+            << std::setw(12) << "ns/matrix" << std::setw(10) << "GFLOP/s"
+            << std::setw(10) << "speedup" << std::setw(11) << "max error"
+            << std::endl;
+  RunSize<4>(pool.get());
+  RunSize<8>(pool.get());
+  RunSize<16>(pool.get());
+  RunSize<32>(pool.get());
+  return 0;
+}
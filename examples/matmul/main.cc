@@ -1,178 +1,363 @@
+#include <algorithm>
 #include <array>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <random>
+#include <string>
+#include <thread>
+#include <vector>
 
-// 版本0: 原始版本的矩阵乘法，效率差的原因是
-// 内循环里对于B的访存是按列的，导致访存不连续，性能较差
-template <int M, int N, int K>
-void MatMulV0(const std::array<std::array<float, N>, M>& A,
-              const std::array<std::array<float, K>, N>& B,
-              std::array<std::array<float, K>, M>& C) {
-  for (int i = 0; i < M; ++i) {
-    for (int k = 0; k < K; ++k) {
-      float v = 0;
-      for (int j = 0; j < N; ++j) {
-        v += A[i][j] * B[j][k];  // C[i][k] = A的第i行和B的第k列的内积
-      }
-      C[i][k] = v;
+#include "matmul.h"
+#include "matrix/gemm.h"
+#include "matrix/thread_pool.h"
+
+// 矩阵乘法的基准测试：对一组形状（方阵、瘦高、非tile整数倍）
+// 运行MatMulV0~V3以及各个微内核和多线程的Gemm，
+// 每个变体先预热，再计时--reps次，报告耗时的中位数和p95以及对应的GFLOP/s，
+// 并以double精度的内积为参考检查结果，有错误时返回非0。
+//
+// 用法: matmul [--reps N] [--csv 文件] [--json 文件]
+//
+// 形状按GEMM的习惯记为m x n x k：C为m x n，公共维度为k。
+// MatMulV*的模板参数为<M, N, K> = <m, k, n>。
+
+namespace {
+
+struct Options {
+  int reps = 10;
+  std::string csv_path;
+  std::string json_path;
+};
+
+struct Result {
+  std::string variant;
+  int m;
+  int n;
+  int k;
+  int threads;
+  double median_ms;
+  double p95_ms;
+  double max_error;  // 超过容差的倍数，不超过1为正确
+  std::string status;  // ok、FAIL或skipped
+};
+
+// MatMulV0~V3的计算量上限（m * n * k），超过时跳过，避免基准运行过久
+constexpr double kNaiveMaxWork = 1 << 26;
+
+// 对所有元素做检查的C的大小上限，更大时随机抽取kSamples个元素
+constexpr int kFullCheckElements = 1 << 16;
+constexpr int kSamples = 1024;
+
+constexpr double kWarmupSeconds = 0.05;
+
+// 运行fn直到至少预热kWarmupSeconds，再计时reps次，返回排序后的每次毫秒数。
+// setup非空时在每次运行fn之前调用，不计入耗时
+std::vector<double> Measure(const std::function<void()>& fn,
+                            const std::function<void()>& setup, int reps) {
+  auto start = std::chrono::steady_clock::now();
+  do {
+    if (setup) {
+      setup();
     }
+    fn();
+  } while (std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+               .count() < kWarmupSeconds);
+  std::vector<double> times;
+  for (int i = 0; i < reps; ++i) {
+    if (setup) {
+      setup();
+    }
+    start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    times.push_back(elapsed.count());
   }
+  std::sort(times.begin(), times.end());
+  return times;
+}
+
+// 已排序数组的百分位数（nearest-rank）
+double Percentile(const std::vector<double>& sorted, double p) {
+  const auto rank = static_cast<std::size_t>(std::ceil(p * sorted.size()));
+  return sorted[std::max<std::size_t>(rank, 1) - 1];
 }
 
-// 版本1: 变换内部2层的循环，使得A，B，C的访存都是行连续访问的
-// 它的实现核心是，对于C矩阵，区分与版本0，它并没有完整的计算出来C[i,j]
-// 而是计算C中的一行的部分结果（1/k），内层循环每完成一次，就累加一次
-template <int M, int N, int K>
-void MatMulV1(const std::array<std::array<float, N>, M>& A,
-              const std::array<std::array<float, K>, N>& B,
-              std::array<std::array<float, K>, M>& C) {
-  for (int i = 0; i < M; ++i) {
-    for (int j = 0; j < N; ++j) {
-      // c[i] = sum_j(A[i][j] * B[j])
-      for (int k = 0; k < K; ++k) {
-        C[i][k] += A[i][j] * B[j][k];
+double GFlops(const Result& r, double ms) {
+  return 2.0 * r.m * r.n * r.k / (ms * 1e6);
+}
+
+// 一个形状上各个变体的结果检查和记录
+class Problem {
+ public:
+  Problem(int m, int n, int k, std::vector<Result>* results)
+      : m_(m), n_(n), k_(k), results_(results) {}
+
+  // c为m x n的结果，按抽样的元素与double精度的内积比较，
+  // 容差为k * eps * sum(|a_ip * b_pj|)
+  double Check(const float* a, const float* b, const float* c) const {
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<int> row(0, m_ - 1);
+    std::uniform_int_distribution<int> col(0, n_ - 1);
+    const bool full = m_ * n_ <= kFullCheckElements;
+    const int count = full ? m_ * n_ : kSamples;
+    double worst = 0;
+    for (int s = 0; s < count; ++s) {
+      const int i = full ? s / n_ : row(gen);
+      const int j = full ? s % n_ : col(gen);
+      double sum = 0;
+      double abs_sum = 0;
+      for (int p = 0; p < k_; ++p) {
+        const double product =
+            static_cast<double>(a[i * k_ + p]) * b[p * n_ + j];
+        sum += product;
+        abs_sum += std::abs(product);
       }
+      const double tolerance =
+          k_ * std::numeric_limits<float>::epsilon() * abs_sum + 1e-6;
+      const double error = std::abs(c[i * n_ + j] - sum) / tolerance;
+      // NaN也视为错误
+      worst = std::isnan(error) ? std::numeric_limits<double>::infinity()
+                                : std::max(worst, error);
     }
+    return worst;
   }
-}
 
-// 版本3: 在版本0的基础上，使用寄存器缓存，来减少A和B从dram中的加载
-// 核心思想是一次计算C中的一个tile
-// 在版本0中，计算C中的一个tile需要从A和B中加载：tileSize*tileSize*N次
-// 在本版本中，计算C中的一个tile需要从A和B中加载：tileSize * N次
-// 从dram中加载数据量为原来的 1 / tileSize
-template <int M, int N, int K>
-void MatMulV2(const std::array<std::array<float, N>, M>& A,
-              const std::array<std::array<float, K>, N>& B,
-              std::array<std::array<float, K>, M>& C) {
-  // 测试发现tile_size=4时，性能没有tile_size=8好
-  // 如果把tile_size设置为16，则可能因为寄存器数量不足，导致性能极差
-  constexpr int tile_size = 8;
-  for (int i = 0; i < M; i += tile_size) {
-    for (int k = 0; k < K; k += tile_size) {
-      float tile[tile_size][tile_size] = {0};
-      for (int j = 0; j < N; ++j) {
-        // 将A[i:i+tileSize][j]和B[j][k:k+tileSize]缓存到寄存器上
-        float register_a[tile_size];
-        float register_b[tile_size];
-        for (int t = 0; t < tile_size; ++t) {
-          register_a[t] = A[i + t][j];
-          register_b[t] = B[j][k + t];
-        }
-        // 计算tile的一个部分结果(1/j)
-        for (int r = 0; r < tile_size; ++r) {
-          for (int c = 0; c < tile_size; ++c) {
-            tile[r][c] += register_a[r] * register_b[c];
-          }
-        }
-      }
-      // 把tile中的数据拷贝回C中
-      for (int r = 0; r < tile_size; r++) {
-        for (int c = 0; c < tile_size; c++) {
-          C[i + r][k + c] = tile[r][c];
-        }
-      }
+  void Run(const std::string& variant, int threads, int reps,
+           const std::function<void()>& fn,
+           const std::function<void()>& setup, const float* a,
+           const float* b, const float* c) {
+    const auto times = Measure(fn, setup, reps);
+    const double error = Check(a, b, c);
+    results_->push_back({variant, m_, n_, k_, threads, Percentile(times, 0.5),
+                         Percentile(times, 0.95), error,
+                         error <= 1 ? "ok" : "FAIL"});
+  }
+
+  void Skip(const std::string& variant) {
+    results_->push_back({variant, m_, n_, k_, 1, 0, 0, 0, "skipped"});
+  }
+
+ private:
+  int m_;
+  int n_;
+  int k_;
+  std::vector<Result>* results_;
+};
+
+template <int R, int C>
+using Array2D = std::array<std::array<float, C>, R>;
+
+template <int R, int C>
+std::unique_ptr<Array2D<R, C>> RandomArray(std::mt19937& gen) {
+  std::normal_distribution<float> dist(0, 1);
+  auto array = std::make_unique<Array2D<R, C>>();
+  for (auto& row : *array) {
+    for (auto& v : row) {
+      v = dist(gen);
     }
   }
+  return array;
 }
 
-// V4版本为CacheLine的版本，先把A和B中的tile行或tile列加载到L1Cache
-template <int M, int N, int K>
-void MatMulV3(const std::array<std::array<float, N>, M>& A,
-              const std::array<std::array<float, K>, N>& B,
-              std::array<std::array<float, K>, M>& C) {
-  constexpr int tile_size = 16;
-  for (int i = 0; i < M; i += tile_size) {
-    // line_cache = A[i:i+tileSize]
-    float line_cache_a[tile_size][N];
-    for (int r = 0; r < tile_size; ++r) {
-      for (int c = 0; c < N; ++c) {
-        line_cache_a[r][c] = A[i + r][c];
-      }
+// 在C为m x n、公共维度为k的形状上运行所有变体
+template <int m, int n, int k>
+void RunShape(const Options& options, gemm::ThreadPool* pool,
+              std::vector<Result>* results) {
+  std::mt19937 gen(0);
+  auto a = RandomArray<m, k>(gen);
+  auto b = RandomArray<k, n>(gen);
+  auto c = std::make_unique<Array2D<m, n>>();
+  const float* a_data = (*a)[0].data();
+  const float* b_data = (*b)[0].data();
+  float* c_data = (*c)[0].data();
+  Problem problem(m, n, k, results);
+  // setup在每次运行fn之前调用，不计入耗时
+  auto run = [&](const std::string& variant, int threads,
+                 const std::function<void()>& fn,
+                 const std::function<void()>& setup = nullptr) {
+    // 清除上一个变体的结果，避免错误的实现因为C中残留的正确值而通过检查
+    std::memset(c_data, 0xff, sizeof(*c));
+    problem.Run(variant, threads, options.reps, fn, setup, a_data, b_data,
+                c_data);
+  };
+
+  const bool naive = static_cast<double>(m) * n * k <= kNaiveMaxWork;
+  if (naive) {
+    run("MatMulV0", 1, [&]() { MatMulV0<m, k, n>(*a, *b, *c); });
+    // MatMulV1把结果累加到C上，每次运行前需要清零，清零不计入耗时
+    run(
+        "MatMulV1", 1, [&]() { MatMulV1<m, k, n>(*a, *b, *c); },
+        [&]() { std::memset(c_data, 0, sizeof(*c)); });
+  } else {
+    problem.Skip("MatMulV0");
+    problem.Skip("MatMulV1");
+  }
+  // MatMulV2/V3要求C的行数和列数是tile的整数倍
+  if constexpr (m % 8 == 0 && n % 8 == 0) {
+    if (naive) {
+      run("MatMulV2", 1, [&]() { MatMulV2<m, k, n>(*a, *b, *c); });
+    } else {
+      problem.Skip("MatMulV2");
     }
-    for (int k = 0; k < K; k += tile_size) {
-      float line_cache_b[N][tile_size];
-      for (int r = 0; r < N; ++r) {
-        for (int c = 0; c < tile_size; ++c) {
-          line_cache_b[r][c] = B[r][k + c];
-        }
-      }
-      float tile[tile_size][tile_size] = {0};
-      for (int r = 0; r < tile_size; ++r) {
-        for (int c = 0; c < tile_size; ++c) {
-          for (int j = 0; j < N; ++j) {
-            tile[r][c] += line_cache_a[r][j] * line_cache_b[j][c];
-          }
-        }
-      }
-      for (int r = 0; r < tile_size; r++) {
-        for (int c = 0; c < tile_size; c++) {
-          C[i + r][k + c] = tile[r][c];
-        }
-      }
+  } else {
+    problem.Skip("MatMulV2");
+  }
+  if constexpr (m % 16 == 0 && n % 16 == 0) {
+    if (naive) {
+      run("MatMulV3", 1, [&]() { MatMulV3<m, k, n>(*a, *b, *c); });
+    } else {
+      problem.Skip("MatMulV3");
     }
+  } else {
+    problem.Skip("MatMulV3");
+  }
+
+  for (const auto& kernel : gemm::AvailableKernels<float>()) {
+    run(std::string("Gemm/") + kernel.name, 1, [&]() {
+      gemm::Gemm(kernel, m, n, k, 1.0F, a_data, k, b_data, n, 0.0F, c_data,
+                 n);
+    });
+  }
+  if (pool != nullptr) {
+    run(std::string("Gemm/") + gemm::DefaultKernel<float>().name,
+        pool->NumThreads(), [&]() {
+          gemm::Gemm(*pool, m, n, k, 1.0F, a_data, k, b_data, n, 0.0F,
+                     c_data, n);
+        });
   }
 }
 
-template <int M, int N>
-std::array<std::array<float, N>, M> Randn(float mean = 0, float var = 1) {
-  // 创建一个正态分布的随机数生成器
-  std::random_device rd;   // 随机数种子
-  std::mt19937 gen(rd());  // Mersenne Twister 19937 生成器
-  std::normal_distribution<float> dist(mean,
-                                       var);  // 均值为0，标准差为1的正态分布
-  std::array<std::array<float, N>, M> array_2d;
-  for (auto& array : array_2d) {
-    for (auto& v : array) {
-      v = dist(gen);
+void PrintTable(const std::vector<Result>& results) {
+  std::cout << std::left << std::setw(16) << "variant" << std::right
+            << std::setw(18) << "m x n x k" << std::setw(8) << "threads"
+            << std::setw(12) << "median ms" << std::setw(12) << "p95 ms"
+            << std::setw(10) << "GFLOP/s" << std::setw(10) << "p95"
+            << std::setw(9) << "status" << std::endl;
+  for (const auto& r : results) {
+    std::cout << std::left << std::setw(16) << r.variant << std::right
+              << std::setw(18)
+              << std::to_string(r.m) + "x" + std::to_string(r.n) + "x" +
+                     std::to_string(r.k)
+              << std::setw(8) << r.threads;
+    if (r.status == "skipped") {
+      std::cout << std::setw(53) << r.status << std::endl;
+      continue;
     }
+    std::cout << std::fixed << std::setprecision(3) << std::setw(12)
+              << r.median_ms << std::setw(12) << r.p95_ms
+              << std::setprecision(1) << std::setw(10)
+              << GFlops(r, r.median_ms) << std::setw(10)
+              << GFlops(r, r.p95_ms) << std::setw(9) << r.status
+              << std::endl;
   }
-  return array_2d;
 }
 
-int main() {
-  constexpr int M = 256;
-  constexpr int N = 256;
-  constexpr int K = 256;
-  auto A = Randn<M, N>();
-  auto B = Randn<N, K>();
-  auto C = Randn<M, K>();
-
-  constexpr int num_runs = 100;
+// GFLOP/s以耗时的中位数和p95计算，p95对应较慢的一端
+void WriteCsv(const std::vector<Result>& results, std::ostream& os) {
+  os << "variant,m,n,k,threads,median_ms,p95_ms,gflops_median,gflops_p95,"
+        "max_error,status\n";
+  for (const auto& r : results) {
+    const bool skipped = r.status == "skipped";
+    os << r.variant << ',' << r.m << ',' << r.n << ',' << r.k << ','
+       << r.threads << ',' << r.median_ms << ',' << r.p95_ms << ','
+       << (skipped ? 0 : GFlops(r, r.median_ms)) << ','
+       << (skipped ? 0 : GFlops(r, r.p95_ms)) << ',' << r.max_error << ','
+       << r.status << '\n';
+  }
+}
 
-  // test MatMulV0~MatMulV3 performance
-  auto start = std::chrono::high_resolution_clock::now();
-  for (int i = 0; i < num_runs; ++i) {
-    MatMulV0<M, N, K>(A, B, C);
+void WriteJson(const std::vector<Result>& results, std::ostream& os) {
+  os << "[\n";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    const bool skipped = r.status == "skipped";
+    os << "  {\"variant\": \"" << r.variant << "\", \"m\": " << r.m
+       << ", \"n\": " << r.n << ", \"k\": " << r.k
+       << ", \"threads\": " << r.threads << ", \"median_ms\": " << r.median_ms
+       << ", \"p95_ms\": " << r.p95_ms
+       << ", \"gflops_median\": " << (skipped ? 0 : GFlops(r, r.median_ms))
+       << ", \"gflops_p95\": " << (skipped ? 0 : GFlops(r, r.p95_ms))
+       << ", \"max_error\": " << r.max_error << ", \"status\": \"" << r.status
+       << "\"}" << (i + 1 < results.size() ? "," : "") << '\n';
   }
-  auto end = std::chrono::high_resolution_clock::now();
-  std::chrono::duration<double> diff = end - start;
-  std::cout << "MatMulV0: " << diff.count() << " s" << std::endl;
+  os << "]\n";
+}
 
-  start = std::chrono::high_resolution_clock::now();
-  for (int i = 0; i < num_runs; ++i) {
-    MatMulV1<M, N, K>(A, B, C);
+bool WriteFile(const std::string& path,
+               void (*writer)(const std::vector<Result>&, std::ostream&),
+               const std::vector<Result>& results) {
+  std::ofstream file(path);
+  if (!file) {
+    std::cerr << "cannot open " << path << std::endl;
+    return false;
   }
-  end = std::chrono::high_resolution_clock::now();
-  diff = end - start;
-  std::cout << "MatMulV1: " << diff.count() << " s" << std::endl;
+  writer(results, file);
+  return true;
+}
+
+}  // namespace
 
-  start = std::chrono::high_resolution_clock::now();
-  for (int i = 0; i < num_runs; ++i) {
-    MatMulV2<M, N, K>(A, B, C);
+int main(int argc, char* argv[]) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (i + 1 < argc && arg == "--reps") {
+      options.reps = std::max(1, std::atoi(argv[++i]));
+    } else if (i + 1 < argc && arg == "--csv") {
+      options.csv_path = argv[++i];
+    } else if (i + 1 < argc && arg == "--json") {
+      options.json_path = argv[++i];
+    } else {
+      std::cerr << "usage: " << argv[0]
+                << " [--reps N] [--csv file] [--json file]" << std::endl;
+      return 2;
+    }
   }
-  end = std::chrono::high_resolution_clock::now();
-  diff = end - start;
-  std::cout << "MatMulV2: " << diff.count() << " s" << std::endl;
 
-  start = std::chrono::high_resolution_clock::now();
-  for (int i = 0; i < num_runs; ++i) {
-    MatMulV3<M, N, K>(A, B, C);
+  // 只有多核时才测试多线程的Gemm
+  const int num_threads =
+      static_cast<int>(std::thread::hardware_concurrency());
+  std::unique_ptr<gemm::ThreadPool> pool;
+  if (num_threads > 1) {
+    pool = std::make_unique<gemm::ThreadPool>(num_threads);
   }
-  end = std::chrono::high_resolution_clock::now();
-  diff = end - start;
-  std::cout << "MatMulV3: " << diff.count() << " s" << std::endl;
 
-  return 0;
-}
\ No newline at end of file
+  std::vector<Result> results;
+  // 方阵
+  RunShape<64, 64, 64>(options, pool.get(), &results);
+  RunShape<256, 256, 256>(options, pool.get(), &results);
+  RunShape<512, 512, 512>(options, pool.get(), &results);
+  RunShape<2048, 2048, 2048>(options, pool.get(), &results);
+  // 瘦高、矮胖以及公共维度很长的矩阵
+  RunShape<8192, 64, 512>(options, pool.get(), &results);
+  RunShape<64, 8192, 512>(options, pool.get(), &results);
+  RunShape<64, 64, 8192>(options, pool.get(), &results);
+  // 不是tile整数倍的形状
+  RunShape<1, 1024, 1024>(options, pool.get(), &results);
+  RunShape<127, 255, 333>(options, pool.get(), &results);
+  RunShape<1000, 1100, 900>(options, pool.get(), &results);
+
+  PrintTable(results);
+  if (!options.csv_path.empty() &&
+      !WriteFile(options.csv_path, WriteCsv, results)) {
+    return 2;
+  }
+  if (!options.json_path.empty() &&
+      !WriteFile(options.json_path, WriteJson, results)) {
+    return 2;
+  }
+  const bool failed =
+      std::any_of(results.begin(), results.end(),
+                  [](const Result& r) { return r.status == "FAIL"; });
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,328 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "matmul.h"
+#include "matrix/batched.h"
+#include "matrix/half.h"
+#include "matrix/matrix.h"
+#include "matrix/strassen.h"
+#include "matrix/thread_pool.h"
+
+namespace {
+
+// 以MatMulV0为参考，检查当前CPU支持的每个微内核。
+// A为M x N，B为N x K，与MatMulV0的约定相同
+template <int M, int N, int K>
+void CheckAllKernels(gemm::ThreadPool* pool = nullptr) {
+  // 矩阵可能较大，放在堆上
+  auto a = std::make_unique<std::array<std::array<float, N>, M>>(
+      Randn<M, N>());
+  auto b = std::make_unique<std::array<std::array<float, K>, N>>(
+      Randn<N, K>());
+  auto expected = std::make_unique<std::array<std::array<float, K>, M>>();
+  MatMulV0<M, N, K>(*a, *b, *expected);
+
+  for (const auto& kernel : gemm::AvailableKernels<float>()) {
+    Matrix<float> c(M, K);
+    if (pool == nullptr) {
+      gemm::Gemm(kernel, M, K, N, 1.0F, (*a)[0].data(), N, (*b)[0].data(), K,
+                 0.0F, c.Data(), K);
+    } else {
+      gemm::Gemm(*pool, kernel, M, K, N, 1.0F, (*a)[0].data(), N,
+                 (*b)[0].data(), K, 0.0F, c.Data(), K);
+    }
+    for (int i = 0; i < M; ++i) {
+      for (int j = 0; j < K; ++j) {
+        ASSERT_NEAR(c.At(i, j), (*expected)[i][j], 1e-3F)
+            << kernel.name << " " << M << "x" << K << "x" << N << " at (" << i
+            << ", " << j << ")";
+      }
+    }
+  }
+}
+
+// Strassen-Winograd与MatMulV0比较，容差随递归层数翻倍
+template <int M, int N, int K>
+void CheckStrassen(int crossover, int levels) {
+  auto a = std::make_unique<std::array<std::array<float, N>, M>>(
+      Randn<M, N>());
+  auto b = std::make_unique<std::array<std::array<float, K>, N>>(
+      Randn<N, K>());
+  auto expected = std::make_unique<std::array<std::array<float, K>, M>>();
+  MatMulV0<M, N, K>(*a, *b, *expected);
+
+  std::vector<float> workspace(
+      gemm::StrassenWorkspaceSize(M, K, N, crossover));
+  Matrix<float> c(M, K);
+  gemm::StrassenGemm(M, K, N, (*a)[0].data(), N, (*b)[0].data(), K, c.Data(),
+                     K, crossover, workspace.data(), workspace.size());
+  const float tolerance = 1e-5F * N * static_cast<float>(1 << levels);
+  for (int i = 0; i < M; ++i) {
+    for (int j = 0; j < K; ++j) {
+      ASSERT_NEAR(c.At(i, j), (*expected)[i][j], tolerance)
+          << M << "x" << K << "x" << N << " at (" << i << ", " << j << ")";
+    }
+  }
+}
+
+// 16位存储的A、B与先转换为float再计算的结果应当相同，
+// 两者打包后的数据完全一样
+template <typename Half>
+void CheckHalfKernels(int m, int n, int k) {
+  std::mt19937 gen(m * 131 + n * 17 + k);
+  std::normal_distribution<float> dist;
+  std::vector<Half> a(m * k);
+  std::vector<Half> b(k * n);
+  std::vector<float> a_float(a.size());
+  std::vector<float> b_float(b.size());
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    a[i] = Half(dist(gen));
+    a_float[i] = static_cast<float>(a[i]);
+  }
+  for (std::size_t i = 0; i < b.size(); ++i) {
+    b[i] = Half(dist(gen));
+    b_float[i] = static_cast<float>(b[i]);
+  }
+  for (const auto& kernel : gemm::AvailableKernels<float>()) {
+    std::vector<float> c(m * n);
+    std::vector<float> expected(m * n);
+    gemm::Gemm(kernel, m, n, k, 0.5F, a.data(), k, b.data(), n, 0.0F,
+               c.data(), n);
+    gemm::Gemm(kernel, m, n, k, 0.5F, a_float.data(), k, b_float.data(), n,
+               0.0F, expected.data(), n);
+    for (int i = 0; i < m * n; ++i) {
+      ASSERT_FLOAT_EQ(c[i], expected[i])
+          << kernel.name << " " << m << "x" << n << "x" << k << " at " << i;
+    }
+  }
+}
+
+// int8微内核与int32的三重循环比较，结果应完全相等。
+// 第一行/列取全-128、第二行/列取全127，检查乘积之和超出int16的情况
+void CheckInt8Kernels(int m, int n, int k, gemm::ThreadPool* pool = nullptr) {
+  std::mt19937 gen(m * 131 + n * 17 + k);
+  std::uniform_int_distribution<int> dist(-128, 127);
+  std::vector<std::int8_t> a(m * k);
+  std::vector<std::int8_t> b(k * n);
+  std::vector<std::int32_t> c0(m * n);
+  for (auto& value : a) {
+    value = static_cast<std::int8_t>(dist(gen));
+  }
+  for (auto& value : b) {
+    value = static_cast<std::int8_t>(dist(gen));
+  }
+  for (auto& value : c0) {
+    value = dist(gen);
+  }
+  for (int p = 0; p < k; ++p) {
+    a[p] = -128;
+    b[p * n] = -128;
+    if (m > 1 && n > 1) {
+      a[k + p] = 127;
+      b[p * n + 1] = 127;
+    }
+  }
+  constexpr std::int32_t beta = 3;
+  std::vector<std::int32_t> expected(m * n);
+  for (int i = 0; i < m; ++i) {
+    for (int j = 0; j < n; ++j) {
+      std::int32_t sum = 0;
+      for (int p = 0; p < k; ++p) {
+        sum += a[i * k + p] * b[p * n + j];
+      }
+      expected[i * n + j] = sum + beta * c0[i * n + j];
+    }
+  }
+
+  for (const auto& kernel : gemm::AvailableInt8Kernels()) {
+    std::vector<std::int32_t> c = c0;
+    if (pool == nullptr) {
+      gemm::Gemm(kernel, m, n, k, a.data(), k, b.data(), n, beta, c.data(),
+                 n);
+    } else {
+      gemm::Gemm(*pool, kernel, m, n, k, a.data(), k, b.data(), n, beta,
+                 c.data(), n);
+    }
+    for (int i = 0; i < m * n; ++i) {
+      ASSERT_EQ(c[i], expected[i])
+          << kernel.name << " " << m << "x" << n << "x" << k << " at " << i;
+    }
+  }
+}
+
+// batch个M x K与K x N的随机矩阵，以及逐个用double计算的乘积
+struct BatchedProblem {
+  std::vector<float> a;
+  std::vector<float> b;
+  std::vector<float> expected;
+};
+
+BatchedProblem MakeBatched(int m, int n, int k, int batch) {
+  std::mt19937 gen(m * 131 + n * 17 + k + batch);
+  std::normal_distribution<float> dist;
+  BatchedProblem problem;
+  problem.a.resize(batch * m * k);
+  problem.b.resize(batch * k * n);
+  problem.expected.resize(batch * m * n);
+  for (auto& value : problem.a) {
+    value = dist(gen);
+  }
+  for (auto& value : problem.b) {
+    value = dist(gen);
+  }
+  for (int t = 0; t < batch; ++t) {
+    for (int i = 0; i < m; ++i) {
+      for (int j = 0; j < n; ++j) {
+        double sum = 0;
+        for (int p = 0; p < k; ++p) {
+          sum += static_cast<double>(problem.a[(t * m + i) * k + p]) *
+                 problem.b[(t * k + p) * n + j];
+        }
+        problem.expected[(t * m + i) * n + j] = static_cast<float>(sum);
+      }
+    }
+  }
+  return problem;
+}
+
+// 检查当前CPU支持的每个批量内核，C原来的内容应被完全覆盖
+template <int M, int N, int K>
+void CheckBatchedKernels(int batch, gemm::ThreadPool* pool = nullptr) {
+  const auto problem = MakeBatched(M, N, K, batch);
+  for (const auto& kernel : gemm::AvailableBatchedKernels<M, N, K, float>()) {
+    std::vector<float> c(batch * M * N, std::nanf(""));
+    gemm::BatchedMatMul<M, N, K>(kernel, batch, problem.a.data(),
+                                 problem.b.data(), c.data(), pool);
+    for (std::size_t i = 0; i < c.size(); ++i) {
+      ASSERT_NEAR(c[i], problem.expected[i], 1e-5F * K)
+          << kernel.name << " " << M << "x" << N << "x" << K << " batch "
+          << batch << " at " << i;
+    }
+  }
+}
+
+}  // namespace
+
+TEST(MatMul, BatchedKernelsMatchNaive) {
+  // batch不是L的整数倍时最后一组不满，M、N不是tile的整数倍时补0，
+  // 矩阵的元素个数小于L时只能逐个元素交错
+  CheckBatchedKernels<4, 4, 4>(1000);
+  CheckBatchedKernels<8, 8, 8>(37);
+  CheckBatchedKernels<16, 16, 16>(33);
+  CheckBatchedKernels<32, 32, 32>(17);
+  CheckBatchedKernels<5, 7, 3>(40);
+  CheckBatchedKernels<3, 9, 6>(16);
+  CheckBatchedKernels<1, 1, 1>(5);
+  CheckBatchedKernels<8, 8, 8>(0);
+  for (int num_threads : {1, 3}) {
+    gemm::ThreadPool pool(num_threads);
+    CheckBatchedKernels<8, 8, 8>(100, &pool);
+    CheckBatchedKernels<5, 7, 3>(20, &pool);
+  }
+}
+
+TEST(MatMul, BatchedRuntimeShape) {
+  gemm::ThreadPool pool(2);
+  // 16有对应的特化，6 x 10 x 7逐个调用Gemm
+  for (const auto& shape : {std::array<int, 3>{16, 16, 16},
+                            std::array<int, 3>{6, 10, 7}}) {
+    const int m = shape[0];
+    const int n = shape[1];
+    const int k = shape[2];
+    const auto problem = MakeBatched(m, n, k, 50);
+    std::vector<float> c(50 * m * n);
+    gemm::BatchedMatMul(m, n, k, 50, problem.a.data(), problem.b.data(),
+                        c.data(), &pool);
+    for (std::size_t i = 0; i < c.size(); ++i) {
+      ASSERT_NEAR(c[i], problem.expected[i], 1e-5F * k)
+          << m << "x" << n << "x" << k << " at " << i;
+    }
+  }
+}
+
+TEST(MatMul, HalfKernelsMatchFloat) {
+  CheckHalfKernels<gemm::BFloat16>(1, 1, 1);
+  CheckHalfKernels<gemm::BFloat16>(37, 71, 53);
+  CheckHalfKernels<gemm::BFloat16>(150, 97, 300);
+  CheckHalfKernels<gemm::Float16>(1, 1, 1);
+  CheckHalfKernels<gemm::Float16>(37, 71, 53);
+  CheckHalfKernels<gemm::Float16>(150, 97, 300);
+}
+
+TEST(MatMul, Int8KernelsAreExact) {
+  // k不是4的倍数时打包补0
+  CheckInt8Kernels(1, 1, 1);
+  CheckInt8Kernels(12, 32, 4);
+  CheckInt8Kernels(7, 5, 33);
+  CheckInt8Kernels(37, 71, 53);
+  CheckInt8Kernels(150, 97, 300);
+  CheckInt8Kernels(290, 301, 530);
+  for (int num_threads : {1, 3}) {
+    gemm::ThreadPool pool(num_threads);
+    CheckInt8Kernels(37, 71, 53, &pool);
+    CheckInt8Kernels(300, 600, 290, &pool);
+  }
+}
+
+TEST(MatMul, DefaultInt8KernelIsFastest) {
+  const auto kernels = gemm::AvailableInt8Kernels();
+  ASSERT_FALSE(kernels.empty());
+  EXPECT_STREQ(kernels.front().name, "generic");
+  EXPECT_STREQ(gemm::DefaultInt8Kernel().name, kernels.back().name);
+}
+
+TEST(MatMul, StrassenMatchesV0) {
+  CheckStrassen<64, 64, 64>(64, 0);
+  CheckStrassen<64, 64, 64>(8, 3);
+  CheckStrassen<256, 256, 256>(32, 3);
+  // 各层都有奇数维需要补齐
+  CheckStrassen<129, 67, 99>(16, 2);
+  CheckStrassen<35, 35, 35>(4, 3);
+}
+
+TEST(MatMul, StrassenWorkspaceTooSmall) {
+  std::vector<float> a(64 * 64);
+  std::vector<float> c(64 * 64);
+  std::vector<float> workspace(gemm::StrassenWorkspaceSize(64, 64, 64, 16));
+  EXPECT_THROW(gemm::StrassenGemm(64, 64, 64, a.data(), 64, a.data(), 64,
+                                  c.data(), 64, 16, workspace.data(),
+                                  workspace.size() - 1),
+               std::invalid_argument);
+  EXPECT_EQ(gemm::StrassenWorkspaceSize(64, 64, 64, 64), 0U);
+}
+
+TEST(MatMul, KernelsMatchV0) {
+  // 小于一个tile、正好一个tile、非tile整数倍、跨越kMc/kKc分块边界
+  CheckAllKernels<1, 1, 1>();
+  CheckAllKernels<12, 32, 32>();
+  CheckAllKernels<7, 33, 5>();
+  CheckAllKernels<37, 53, 71>();
+  CheckAllKernels<150, 300, 97>();
+  CheckAllKernels<290, 530, 301>();
+}
+
+TEST(MatMul, ParallelKernelsMatchV0) {
+  // 线程数多于宏tile数时部分线程领不到任务，
+  // 600列跨越了两个宏tile列，4100列跨越了kNc
+  for (int num_threads : {1, 3, 4}) {
+    gemm::ThreadPool pool(num_threads);
+    CheckAllKernels<1, 1, 1>(&pool);
+    CheckAllKernels<37, 53, 71>(&pool);
+    CheckAllKernels<300, 290, 600>(&pool);
+    CheckAllKernels<20, 20, 4100>(&pool);
+  }
+}
+
+TEST(MatMul, DefaultKernelIsFastest) {
+  const auto kernels = gemm::AvailableKernels<float>();
+  ASSERT_FALSE(kernels.empty());
+  EXPECT_STREQ(kernels.front().name, "generic");
+  EXPECT_STREQ(gemm::DefaultKernel<float>().name, kernels.back().name);
+}
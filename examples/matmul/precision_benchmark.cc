@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "matrix/gemm.h"
+#include "matrix/half.h"
+
+// float、BFloat16、Float16和int8存储的A、B在不同m下的耗时，
+// n = k = 4096，m较小时读取B的带宽是瓶颈。
+// 用法: matmul_precision [m...]，默认为1、16、64和256
+//
+// GB/s按A、B、C各读写一次的字节数计算。
+// 误差为抽样元素与float输入的double精度内积的最大绝对误差除以max|C|，
+// int8按各自的max|x| / 127对称量化，结果再乘回两个缩放系数。
+
+namespace {
+
+constexpr int kN = 4096;
+constexpr int kK = 4096;
+constexpr int kSamples = 256;
+
+struct Inputs {
+  int m;
+  std::vector<float> a;
+  std::vector<float> b;
+};
+
+// 与double精度内积比较的相对误差，scale为c到真实结果的缩放系数
+template <typename TC>
+double RelativeError(const Inputs& in, const std::vector<TC>& c,
+                     double scale) {
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<int> row(0, in.m - 1);
+  std::uniform_int_distribution<int> col(0, kN - 1);
+  double max_error = 0;
+  double max_value = 0;
+  for (int s = 0; s < kSamples; ++s) {
+    const int i = row(gen);
+    const int j = col(gen);
+    double sum = 0;
+    for (int p = 0; p < kK; ++p) {
+      sum += static_cast<double>(in.a[i * kK + p]) * in.b[p * kN + j];
+    }
+    max_error = std::max(max_error, std::abs(c[i * kN + j] * scale - sum));
+    max_value = std::max(max_value, std::abs(sum));
+  }
+  return max_error / max_value;
+}
+
+// 对称量化为int8，返回缩放系数
+double Quantize(const std::vector<float>& x, std::vector<std::int8_t>* q) {
+  float max_abs = 0;
+  for (float value : x) {
+    max_abs = std::max(max_abs, std::abs(value));
+  }
+  const double scale = max_abs / 127.0;
+  q->resize(x.size());
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    (*q)[i] = static_cast<std::int8_t>(std::lround(x[i] / scale));
+  }
+  return scale;
+}
+
+template <typename TIn>
+std::vector<TIn> Convert(const std::vector<float>& x) {
+  std::vector<TIn> result(x.size());
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    result[i] = TIn(x[i]);
+  }
+  return result;
+}
+
+// 取3次中最快的一次，单位为毫秒
+template <typename F>
+double Time(F run) {
+  run();  // 预热
+  double best = 1e30;
+  for (int rep = 0; rep < 3; ++rep) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+void Report(const std::string& type, int m, double ms, std::size_t bytes,
+            double error) {
+  std::cout << std::setw(6) << m << std::setw(10) << type << std::setw(10)
+            << std::fixed << std::setprecision(2) << ms << std::setw(10)
+            << std::setprecision(1) << 2.0 * m * kN * kK / (ms * 1e6)
+            << std::setw(8) << bytes / (ms * 1e6) << std::setw(12)
+            << std::scientific << std::setprecision(2) << error << std::endl;
+}
+
+// 16位或float存储的A、B，C为float
+template <typename TIn>
+void RunFloat(const std::string& type, const Inputs& in) {
+  const auto a = Convert<TIn>(in.a);
+  const auto b = Convert<TIn>(in.b);
+  std::vector<float> c(static_cast<std::size_t>(in.m) * kN);
+  const double ms = Time([&]() {
+    gemm::Gemm(in.m, kN, kK, 1.0F, a.data(), kK, b.data(), kN, 0.0F,
+               c.data(), kN);
+  });
+  const std::size_t bytes = (a.size() + b.size()) * sizeof(TIn) +
+                            c.size() * sizeof(float);
+  Report(type, in.m, ms, bytes, RelativeError(in, c, 1.0));
+}
+
+void RunInt8(const Inputs& in) {
+  std::vector<std::int8_t> a;
+  std::vector<std::int8_t> b;
+  const double scale = Quantize(in.a, &a) * Quantize(in.b, &b);
+  std::vector<std::int32_t> c(static_cast<std::size_t>(in.m) * kN);
+  const double ms = Time([&]() {
+    gemm::Gemm(in.m, kN, kK, 1, a.data(), kK, b.data(), kN, 0, c.data(), kN);
+  });
+  const std::size_t bytes = a.size() + b.size() + c.size() * sizeof(int);
+  Report("int8", in.m, ms, bytes, RelativeError(in, c, scale));
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::vector<int> ms;
+  for (int i = 1; i < argc; ++i) {
+    ms.push_back(std::atoi(argv[i]));
+  }
+  if (ms.empty()) {
+    ms = {1, 16, 64, 256};
+  }
+  std::cout << "n = k = " << kN << ", kernels: "
+            << gemm::DefaultKernel<float>().name << " / "
+            << gemm::DefaultInt8Kernel().name << std::endl;
+  std::cout << std::setw(6) << "m" << std::setw(10) << "type" << std::setw(10)
+            << "ms" << std::setw(10) << "GOP/s" << std::setw(8) << "GB/s"
+            << std::setw(12) << "rel error" << std::endl;
+  std::mt19937 gen(0);
+  std::normal_distribution<float> dist(0, 1);
+  Inputs in;
+  in.b.resize(static_cast<std::size_t>(kK) * kN);
+  for (auto& value : in.b) {
+    value = dist(gen);
+  }
+  for (int m : ms) {
+    in.m = m;
+    in.a.resize(static_cast<std::size_t>(m) * kK);
+    for (auto& value : in.a) {
+      value = dist(gen);
+    }
+    RunFloat<float>("float", in);
+    RunFloat<gemm::BFloat16>("bf16", in);
+    RunFloat<gemm::Float16>("fp16", in);
+    RunInt8(in);
+  }
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "matrix/gemm.h"
+#include "matrix/thread_pool.h"
+
+// 多线程Gemm的GFLOP/s随线程数的变化
+// 用法: matmul_scaling [最大线程数] [矩阵尺寸...]
+// 默认最大线程数为hardware_concurrency，尺寸为2048和4096
+int main(int argc, char* argv[]) {
+  int max_threads = static_cast<int>(std::thread::hardware_concurrency());
+  if (argc > 1) {
+    max_threads = std::atoi(argv[1]);
+  }
+  max_threads = std::max(max_threads, 1);
+  std::vector<int> sizes;
+  for (int i = 2; i < argc; ++i) {
+    sizes.push_back(std::atoi(argv[i]));
+  }
+  if (sizes.empty()) {
+    sizes = {2048, 4096};
+  }
+  // 1, 2, 4, ...，最后一组正好是max_threads
+  std::vector<int> thread_counts;
+  for (int threads = 1; threads < max_threads; threads *= 2) {
+    thread_counts.push_back(threads);
+  }
+  thread_counts.push_back(max_threads);
+
+  std::cout << "kernel: " << gemm::DefaultKernel<float>().name << std::endl;
+  std::cout << std::setw(6) << "size" << std::setw(9) << "threads"
+            << std::setw(10) << "GFLOP/s" << std::setw(9) << "speedup"
+            << std::endl;
+  std::mt19937 gen(0);
+  std::normal_distribution<float> dist(0, 1);
+  for (int n : sizes) {
+    std::vector<float> a(static_cast<std::size_t>(n) * n);
+    std::vector<float> b(a.size());
+    std::vector<float> c(a.size());
+    for (std::size_t i = 0; i < a.size(); ++i) {
+      a[i] = dist(gen);
+      b[i] = dist(gen);
+    }
+    double single_thread = 0;
+    for (int threads : thread_counts) {
+      gemm::ThreadPool pool(threads);
+      auto run = [&]() {
+        gemm::Gemm(pool, n, n, n, 1.0F, a.data(), n, b.data(), n, 0.0F,
+                   c.data(), n);
+      };
+      run();  // 预热，同时让线程池的线程全部启动
+      // 至少运行0.5秒，取平均
+      int num_runs = 0;
+      std::chrono::duration<double> elapsed(0);
+      auto start = std::chrono::steady_clock::now();
+      while (elapsed.count() < 0.5) {
+        run();
+        ++num_runs;
+        elapsed = std::chrono::steady_clock::now() - start;
+      }
+      const double gflops = 2.0 * n * n * n * num_runs / elapsed.count() * 1e-9;
+      if (threads == 1) {
+        single_thread = gflops;
+      }
+      std::cout << std::setw(6) << n << std::setw(9) << threads
+                << std::setw(10) << std::fixed << std::setprecision(1)
+                << gflops << std::setw(9) << std::setprecision(2)
+                << gflops / single_thread << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "matrix/gemm.h"
+#include "matrix/strassen.h"
+
+// Strassen-Winograd与分块Gemm在不同crossover下的耗时和误差，
+// 用于确定当前机器上的crossover。
+// 用法: matmul_strassen [矩阵尺寸...]，默认为1024、2048和4096
+//
+// GFLOP/s按2n^3计算，Strassen的实际运算量更少，所以可以超过峰值。
+// 误差为抽样元素与double精度内积的最大绝对误差除以max|C|。
+
+namespace {
+
+constexpr int kSamples = 256;
+
+double RelativeError(int n, const std::vector<float>& a,
+                     const std::vector<float>& b,
+                     const std::vector<float>& c) {
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<int> index(0, n - 1);
+  double max_error = 0;
+  double max_value = 0;
+  for (int s = 0; s < kSamples; ++s) {
+    const int i = index(gen);
+    const int j = index(gen);
+    double sum = 0;
+    for (int p = 0; p < n; ++p) {
+      sum += static_cast<double>(a[i * n + p]) * b[p * n + j];
+    }
+    max_error = std::max(max_error, std::abs(c[i * n + j] - sum));
+    max_value = std::max(max_value, std::abs(sum));
+  }
+  return max_error / max_value;
+}
+
+// 递归的层数
+int Levels(int n, int crossover) {
+  int levels = 0;
+  for (; n > crossover; n /= 2) {
+    ++levels;
+  }
+  return levels;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::vector<int> sizes;
+  for (int i = 1; i < argc; ++i) {
+    sizes.push_back(std::atoi(argv[i]));
+  }
+  if (sizes.empty()) {
+    sizes = {1024, 2048, 4096};
+  }
+  std::cout << std::setw(6) << "size" << std::setw(11) << "crossover"
+            << std::setw(8) << "levels" << std::setw(11) << "ms"
+            << std::setw(10) << "GFLOP/s" << std::setw(12) << "rel error"
+            << std::endl;
+  std::mt19937 gen(0);
+  std::normal_distribution<float> dist(0, 1);
+  for (int n : sizes) {
+    std::vector<float> a(static_cast<std::size_t>(n) * n);
+    std::vector<float> b(a.size());
+    std::vector<float> c(a.size());
+    for (std::size_t i = 0; i < a.size(); ++i) {
+      a[i] = dist(gen);
+      b[i] = dist(gen);
+    }
+    // crossover为n时即为不递归的分块Gemm
+    for (int crossover = n; crossover >= 128; crossover /= 2) {
+      std::vector<float> workspace(
+          gemm::StrassenWorkspaceSize(n, n, n, crossover));
+      auto run = [&]() {
+        gemm::StrassenGemm(n, n, n, a.data(), n, b.data(), n, c.data(), n,
+                           crossover, workspace.data(), workspace.size());
+      };
+      run();  // 预热
+      // 取3次中最快的一次
+      double best = 1e30;
+      for (int rep = 0; rep < 3; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+      }
+      std::cout << std::setw(6) << n << std::setw(11) << crossover
+                << std::setw(8) << Levels(n, crossover) << std::setw(11)
+                << std::fixed << std::setprecision(1) << best << std::setw(10)
+                << 2.0 * n * n * n / (best * 1e6) << std::setw(12)
+                << std::scientific << std::setprecision(2)
+                << RelativeError(n, a, b, c) << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,72 @@
+#include <chrono>  // 包含计时器头文件
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "autodiff/simd_math.h"
+
+// 对n个float调用fn，重复num_runs次，返回每秒处理的元素个数（百万）
+template <typename Fn>
+double Throughput(Fn fn, const std::vector<float>& x, std::vector<float>& y,
+                  int num_runs) {
+  fn(x.data(), y.data(), x.size());  // 预热
+  auto start_time = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < num_runs; i++) {
+    fn(x.data(), y.data(), x.size());
+  }
+  auto end_time = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed_time = end_time - start_time;
+  return static_cast<double>(x.size()) * num_runs / elapsed_time.count() / 1e6;
+}
+
+void Report(const std::string& name, double std_throughput,
+            double simd_throughput) {
+  std::cout << name << ": std " << std_throughput << " M/s, simd "
+            << simd_throughput << " M/s, speedup "
+            << simd_throughput / std_throughput << "x" << std::endl;
+}
+
+int main() {
+  const int n = 1 << 20;   // 指定向量长度
+  const int num_runs = 50;  // 指定运行次数
+
+  std::vector<float> x(n);
+  std::vector<float> positive(n);
+  std::vector<float> y(n);
+  for (int i = 0; i < n; i++) {
+    x[i] = static_cast<float>(i) / n * 20.0F - 10.0F;
+    positive[i] = static_cast<float>(i + 1) / n * 100.0F;
+  }
+
+  auto std_sin = [](const float* in, float* out, std::size_t size) {
+    for (std::size_t i = 0; i < size; ++i) {
+      out[i] = std::sin(in[i]);
+    }
+  };
+  auto std_cos = [](const float* in, float* out, std::size_t size) {
+    for (std::size_t i = 0; i < size; ++i) {
+      out[i] = std::cos(in[i]);
+    }
+  };
+  auto std_exp = [](const float* in, float* out, std::size_t size) {
+    for (std::size_t i = 0; i < size; ++i) {
+      out[i] = std::exp(in[i]);
+    }
+  };
+  auto std_log = [](const float* in, float* out, std::size_t size) {
+    for (std::size_t i = 0; i < size; ++i) {
+      out[i] = std::log(in[i]);
+    }
+  };
+
+  Report("sin", Throughput(std_sin, x, y, num_runs),
+         Throughput(ad::simd::Sin, x, y, num_runs));
+  Report("cos", Throughput(std_cos, x, y, num_runs),
+         Throughput(ad::simd::Cos, x, y, num_runs));
+  Report("exp", Throughput(std_exp, x, y, num_runs),
+         Throughput(ad::simd::Exp, x, y, num_runs));
+  Report("log", Throughput(std_log, positive, y, num_runs),
+         Throughput(ad::simd::Log, positive, y, num_runs));
+  return 0;
+}
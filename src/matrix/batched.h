@@ -0,0 +1,342 @@
+#ifndef SRC_MATRIX_BATCHED_H_
+#define SRC_MATRIX_BATCHED_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "matrix/gemm.h"
+#include "matrix/thread_pool.h"
+
+/*
+ * \brief 大量同形状小矩阵的乘法 C[i] = A[i] * B[i]，行主序，
+ * A[i]为M x K，B[i]为K x N，各矩阵在a、b、c中依次紧密排列。
+ *
+ * 每L个矩阵为一组，先转换为交错布局：L个矩阵同一位置的元素相邻，
+ * 正好组成一个SIMD向量，于是一组的乘法就是标量三重循环中的每个乘加
+ * 换成L个通道的向量乘加，不需要广播或跨通道的操作，任意形状都能用满向量。
+ * 形状是模板参数，循环边界全部是编译期常量，C按Tm x Tn的tile
+ * 放在寄存器中累加，M、N不是tile的整数倍时交错布局中补齐。
+ *
+ * float在x86上根据运行时的cpuid选择AVX-512（L = 16）或AVX2（L = 8），
+ * 与gemm.h的微内核一样用target属性单独编译；其他情况使用L = 8的通用版本。
+ * 向量运算和交错时的转置都用GCC/Clang的向量扩展写成，
+ * 按所在函数的指令集生成SIMD指令。传入ThreadPool时各组平均分给所有线程。
+ *
+ * 与逐个调用Gemm相比省去了每次的分派、打包和缓冲区分配，
+ * 也不受单个矩阵太小、填不满微内核tile的限制。
+ */
+namespace gemm {
+
+// 处理一组至多lanes个矩阵：run(count, a, b, c, scratch)计算前count个，
+// scratch至少有scratch_size个元素，初始内容不影响结果
+template <typename T>
+struct BatchedKernel {
+  const char* name;
+  int lanes;
+  int scratch_size;
+  void (*run)(int count, const T* a, const T* b, T* c, T* scratch);
+};
+
+namespace internal {
+
+// 寄存器tile的大小：AVX2只有16个向量寄存器，L = 8时减为2行
+constexpr int kBatchTn = 4;
+
+template <int L>
+constexpr int kBatchTm = L >= 16 ? 4 : 2;
+
+// 一组的交错缓冲区：A为Mp x K，B为K x Np，C为Mp x Np，每个元素L个通道
+template <int M, int N, int K, int L>
+constexpr int BatchedScratchSize() {
+  constexpr int mp = RoundUp(M, kBatchTm<L>);
+  constexpr int np = RoundUp(N, kBatchTn);
+  return (mp * K + K * np + mp * np) * L;
+}
+
+// L个通道的向量，GCC/Clang的向量扩展，按所在函数的指令集编译为SIMD指令
+template <typename T, int L>
+struct Lanes {
+  typedef T Type __attribute__((vector_size(sizeof(T) * L)));
+};
+
+// 交错布局上的乘法，c = a * b，a为Mp x K，b为K x Np。
+// 缓冲区只按T对齐，用memcpy读写向量
+template <typename T, int Mp, int Np, int K, int L>
+inline void InterleavedMatMul(const T* a, const T* b, T* c) {
+  using Vec = typename Lanes<T, L>::Type;
+  constexpr int tm = kBatchTm<L>;
+  constexpr int tn = kBatchTn;
+  for (int i = 0; i < Mp; i += tm) {
+    for (int j = 0; j < Np; j += tn) {
+      Vec acc[tm][tn] = {};
+      for (int p = 0; p < K; ++p) {
+        Vec a_value[tm];
+        Vec b_value[tn];
+#pragma GCC unroll 4
+        for (int r = 0; r < tm; ++r) {
+          std::memcpy(&a_value[r], a + ((i + r) * K + p) * L, sizeof(Vec));
+        }
+#pragma GCC unroll 4
+        for (int col = 0; col < tn; ++col) {
+          std::memcpy(&b_value[col], b + (p * Np + j + col) * L, sizeof(Vec));
+        }
+#pragma GCC unroll 4
+        for (int r = 0; r < tm; ++r) {
+#pragma GCC unroll 4
+          for (int col = 0; col < tn; ++col) {
+            acc[r][col] += a_value[r] * b_value[col];
+          }
+        }
+      }
+#pragma GCC unroll 4
+      for (int r = 0; r < tm; ++r) {
+#pragma GCC unroll 4
+        for (int col = 0; col < tn; ++col) {
+          std::memcpy(c + ((i + r) * Np + j + col) * L, &acc[r][col],
+                      sizeof(Vec));
+        }
+      }
+    }
+  }
+}
+
+// 转置的一步：对于下标中d对应的位为0的x和为1的y，
+// 交换x中该位为1的元素与y中该位为0的元素
+template <int D, int L, typename Vec, std::size_t... Is>
+inline void SwapBlocks(Vec& x, Vec& y, std::index_sequence<Is...>) {
+  const Vec low = __builtin_shufflevector(
+      x, y, static_cast<int>((Is & D) == 0 ? Is : L + Is - D)...);
+  const Vec high = __builtin_shufflevector(
+      x, y, static_cast<int>((Is & D) == 0 ? Is + D : L + Is)...);
+  x = low;
+  y = high;
+}
+
+template <int D, int L, typename Vec>
+inline void TransposeStages(Vec* rows) {
+#pragma GCC unroll 16
+  for (int i = 0; i < L; ++i) {
+    if ((i & D) == 0) {
+      SwapBlocks<D, L>(rows[i], rows[i + D], std::make_index_sequence<L>());
+    }
+  }
+  if constexpr (D > 1) {
+    TransposeStages<D / 2, L>(rows);
+  }
+}
+
+// 在寄存器中转置L x L的块，src和dst的行间隔分别为src_ld和dst_ld。
+// log2(L)步，每步对每对行做两次双源shuffle
+template <typename T, int L>
+inline void TransposeBlock(const T* src, int src_ld, T* dst, int dst_ld) {
+  using Vec = typename Lanes<T, L>::Type;
+  Vec rows[L];
+#pragma GCC unroll 16
+  for (int r = 0; r < L; ++r) {
+    std::memcpy(&rows[r], src + r * src_ld, sizeof(Vec));
+  }
+  TransposeStages<L / 2, L>(rows);
+#pragma GCC unroll 16
+  for (int r = 0; r < L; ++r) {
+    std::memcpy(dst + r * dst_ld, &rows[r], sizeof(Vec));
+  }
+}
+
+// 在count个连续存放的、各有size个元素的矩阵与交错布局之间转换，
+// 交错布局中第l个矩阵的第e个元素在interleaved[e * L + l]。
+// 一组满L个时按L x L的块转置，不足一块的部分和最后一组逐个元素复制
+template <typename T, int L>
+inline void Interleave(int count, int size, const T* matrices,
+                       T* interleaved) {
+  int e = 0;
+  if (count == L) {
+    for (; e + L <= size; e += L) {
+      TransposeBlock<T, L>(matrices + e, size, interleaved + e * L, L);
+    }
+  }
+  for (int l = 0; l < count; ++l) {
+    for (int i = e; i < size; ++i) {
+      interleaved[i * L + l] = matrices[l * size + i];
+    }
+  }
+}
+
+template <typename T, int L>
+inline void Deinterleave(int count, int size, const T* interleaved,
+                         T* matrices) {
+  int e = 0;
+  if (count == L) {
+    for (; e + L <= size; e += L) {
+      TransposeBlock<T, L>(interleaved + e * L, L, matrices + e, size);
+    }
+  }
+  for (int l = 0; l < count; ++l) {
+    for (int i = e; i < size; ++i) {
+      matrices[l * size + i] = interleaved[i * L + l];
+    }
+  }
+}
+
+// 一组count（不超过L）个矩阵的乘法。M、N不是tile的整数倍时，
+// A和C的交错布局多出若干行，B和C多出若干列，
+// 这时B和C先在scratch中按原来的列数交错，再逐行移到补齐后的位置。
+// 多出的行列和最后一组中多余的通道只影响C中被丢弃的部分，
+// 所以不需要清零
+template <typename T, int M, int N, int K, int L>
+inline void BatchedGroup(int count, const T* a, const T* b, T* c,
+                         T* scratch) {
+  constexpr int mp = RoundUp(M, kBatchTm<L>);
+  constexpr int np = RoundUp(N, kBatchTn);
+  T* a_il = scratch;
+  T* b_il = a_il + mp * K * L;
+  T* c_il = b_il + K * np * L;
+  Interleave<T, L>(count, M * K, a, a_il);
+  Interleave<T, L>(count, K * N, b, b_il);
+  if constexpr (np != N) {
+    // 从最后一行开始往后移，不会覆盖还没有移动的行
+    for (int p = K - 1; p > 0; --p) {
+      std::memmove(b_il + p * np * L, b_il + p * N * L, N * L * sizeof(T));
+    }
+  }
+  InterleavedMatMul<T, mp, np, K, L>(a_il, b_il, c_il);
+  if constexpr (np != N) {
+    for (int i = 1; i < M; ++i) {
+      std::memmove(c_il + i * N * L, c_il + i * np * L, N * L * sizeof(T));
+    }
+  }
+  Deinterleave<T, L>(count, M * N, c_il, c);
+}
+
+template <typename T, int M, int N, int K>
+void BatchedGroupGeneric(int count, const T* a, const T* b, T* c,
+                         T* scratch) {
+  BatchedGroup<T, M, N, K, 8>(count, a, b, c, scratch);
+}
+
+#ifdef GEMM_X86
+// flatten把BatchedGroup整个内联进来，按各自的指令集编译
+template <int M, int N, int K>
+__attribute__((target("avx2,fma"), flatten)) void BatchedGroupAvx2(
+    int count, const float* a, const float* b, float* c, float* scratch) {
+  BatchedGroup<float, M, N, K, 8>(count, a, b, c, scratch);
+}
+
+template <int M, int N, int K>
+__attribute__((target("avx512f"), flatten)) void BatchedGroupAvx512(
+    int count, const float* a, const float* b, float* c, float* scratch) {
+  BatchedGroup<float, M, N, K, 16>(count, a, b, c, scratch);
+}
+#endif  // GEMM_X86
+
+}  // namespace internal
+
+// 当前CPU支持的所有批量内核，第一个是通用版本，最后一个最快
+template <int M, int N, int K, typename T>
+std::vector<BatchedKernel<T>> AvailableBatchedKernels() {
+  std::vector<BatchedKernel<T>> kernels = {
+      {"generic", 8, internal::BatchedScratchSize<M, N, K, 8>(),
+       &internal::BatchedGroupGeneric<T, M, N, K>}};
+#ifdef GEMM_X86
+  if constexpr (std::is_same_v<T, float>) {
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      kernels.push_back({"avx2", 8, internal::BatchedScratchSize<M, N, K, 8>(),
+                         &internal::BatchedGroupAvx2<M, N, K>});
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+      kernels.push_back({"avx512", 16,
+                         internal::BatchedScratchSize<M, N, K, 16>(),
+                         &internal::BatchedGroupAvx512<M, N, K>});
+    }
+  }
+#endif  // GEMM_X86
+  return kernels;
+}
+
+template <int M, int N, int K, typename T>
+const BatchedKernel<T>& DefaultBatchedKernel() {
+  static const BatchedKernel<T> kernel = AvailableBatchedKernels<M, N, K, T>()
+                                             .back();
+  return kernel;
+}
+
+// 使用指定的批量内核计算，主要用于测试和基准比较各个内核
+template <int M, int N, int K, typename T>
+void BatchedMatMul(const BatchedKernel<T>& kernel, int batch, const T* a,
+                   const T* b, T* c, ThreadPool* pool = nullptr) {
+  if (batch <= 0) {
+    return;
+  }
+  const int lanes = kernel.lanes;
+  const int groups = (batch + lanes - 1) / lanes;
+  const int num_threads = pool == nullptr ? 1 : pool->NumThreads();
+  auto work = [&](int thread) {
+    const int begin = groups * thread / num_threads;
+    const int end = groups * (thread + 1) / num_threads;
+    if (begin == end) {
+      return;
+    }
+    std::vector<T> scratch(kernel.scratch_size);
+    for (int g = begin; g < end; ++g) {
+      const int first = g * lanes;
+      const std::size_t offset = first;
+      kernel.run(std::min(lanes, batch - first), a + offset * M * K,
+                 b + offset * K * N, c + offset * M * N, scratch.data());
+    }
+  };
+  if (pool == nullptr) {
+    work(0);
+  } else {
+    pool->Run(work);
+  }
+}
+
+template <int M, int N, int K, typename T>
+void BatchedMatMul(int batch, const T* a, const T* b, T* c,
+                   ThreadPool* pool = nullptr) {
+  BatchedMatMul<M, N, K>(DefaultBatchedKernel<M, N, K, T>(), batch, a, b, c,
+                         pool);
+}
+
+// 形状在运行时给出：M = N = K为4、8、16或32时使用对应的特化，
+// 其他形状逐个调用Gemm
+template <typename T>
+void BatchedMatMul(int m, int n, int k, int batch, const T* a, const T* b,
+                   T* c, ThreadPool* pool = nullptr) {
+  if (m == n && n == k) {
+    switch (m) {
+      case 4:
+        return BatchedMatMul<4, 4, 4>(batch, a, b, c, pool);
+      case 8:
+        return BatchedMatMul<8, 8, 8>(batch, a, b, c, pool);
+      case 16:
+        return BatchedMatMul<16, 16, 16>(batch, a, b, c, pool);
+      case 32:
+        return BatchedMatMul<32, 32, 32>(batch, a, b, c, pool);
+      default:
+        break;
+    }
+  }
+  const int num_threads = pool == nullptr ? 1 : pool->NumThreads();
+  auto work = [&](int thread) {
+    const int begin = batch * thread / num_threads;
+    const int end = batch * (thread + 1) / num_threads;
+    for (std::size_t i = begin; i < static_cast<std::size_t>(end); ++i) {
+      Gemm(m, n, k, T(1), a + i * m * k, k, b + i * k * n, n, T(0),
+           c + i * m * n, n);
+    }
+  };
+  if (pool == nullptr) {
+    work(0);
+  } else {
+    pool->Run(work);
+  }
+}
+
+}  // namespace gemm
+
+#endif  // SRC_MATRIX_BATCHED_H_
@@ -0,0 +1,621 @@
+#ifndef SRC_MATRIX_GEMM_H_
+#define SRC_MATRIX_GEMM_H_
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define GEMM_X86 1
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+#include "matrix/thread_pool.h"
+
+/*
+ * \brief 行主序矩阵乘法 C = alpha * A * B + beta * C，A为m x k，B为k x n，
+ * lda/ldb/ldc为各矩阵相邻两行的间隔（元素个数）。
+ *
+ * 按照GotoBLAS的方式分三级分块：
+ *   jc: B的kNc列，打包后的B块放在L3中
+ *   pc: 公共维度的kKc个元素，打包后的B微面板（kKc x nr）放在L1中
+ *   ic: A的kMc行，打包后的A块（kMc x kKc）放在L2中
+ * 最内层的微内核用mr x nr个累加器计算C的一个tile，
+ * 每读入A的mr个元素和B的nr个元素做mr * nr次乘加。
+ * 打包时把A和B排成微内核按顺序读取的布局，不足一个tile的边缘补0，
+ * 所以微内核不需要处理边界，任意的m、n、k都走同一条路径。
+ * float在x86上根据运行时的cpuid选择AVX-512（12 x 32）或AVX2（6 x 16）的
+ * FMA微内核，两者都用target属性单独编译，不需要-mavx2等编译选项，
+ * 同一个二进制可以在不支持这些指令集的机器上运行。
+ * 其他情况使用依赖编译器自动向量化的通用微内核。
+ *
+ * 传入ThreadPool时把C划分为二维的宏tile在各线程上并行计算，
+ * 打包后的B块由所有线程共享。
+ *
+ * A和B的元素类型可以与C不同，打包时转换为C的类型，例如BFloat16/Float16
+ * （见half.h）的A、B与float的C。int8_t的A、B与int32_t的C在alpha为1时
+ * 使用专门的int8微内核，按int32精确累加：AVX-512 VNNI时为vpdpbusd，
+ * AVX2时扩展为int16后用vpmaddwd。
+ *
+ * \note beta为0时不读取C，C中原有的NaN不会传播到结果里。
+ */
+namespace gemm {
+
+// 微内核及其tile大小：run(kc, a, b, c, ldc)计算C[0:mr, 0:nr] += a * b，
+// a和b为打包后的微面板。Packed为打包后的元素类型，Value为C的元素类型，
+// 打包时k方向每kDepth个元素为一组连续存放
+template <typename T>
+struct Kernel {
+  using Packed = T;
+  using Value = T;
+  static constexpr int kDepth = 1;
+
+  const char* name;
+  int mr;
+  int nr;
+  void (*run)(int kc, const T* a, const T* b, T* c, int ldc);
+};
+
+// int8 x int8 -> int32的微内核，k方向每4个元素为一组，
+// 不足的部分补0，run的kc为补齐后的长度
+struct Int8Kernel {
+  using Packed = std::int8_t;
+  using Value = std::int32_t;
+  static constexpr int kDepth = 4;
+
+  const char* name;
+  int mr;
+  int nr;
+  void (*run)(int kc, const std::int8_t* a, const std::int8_t* b,
+              std::int32_t* c, int ldc);
+};
+
+namespace internal {
+
+// 通用微内核的tile大小
+constexpr int kMr = 6;
+constexpr int kNr = 16;
+
+// 所有微内核中最大的tile，用于边缘的临时缓冲区
+constexpr int kMaxMr = 12;
+constexpr int kMaxNr = 32;
+
+// 各级分块的大小，以float计（kMc是所有微内核mr的倍数）：
+// B微面板kKc x 32为32KB，A块kMc x kKc为144KB，B块kKc x kNc为4MB
+constexpr int kKc = 256;
+constexpr int kMc = 144;
+constexpr int kNc = 4096;
+
+// 多线程时宏tile的列数，是所有微内核nr的倍数，
+// 宏tile内的B微面板在打包后的B块中是连续的
+constexpr int kNt = 512;
+
+template <typename T>
+bool IsZero(const T& value) {
+  if constexpr (std::is_floating_point_v<T>) {
+    return std::fpclassify(value) == FP_ZERO;
+  } else {
+    return value == T();
+  }
+}
+
+// 把A[0:mc, 0:kc]转换为P并乘上alpha，打包为若干个mr行的微面板。
+// 每个微面板内k方向每Depth个元素为一组，按组的顺序存放mr x Depth个元素，
+// 不足mr行或不足一组的部分补0
+template <int Depth, typename P, typename TA>
+void PackA(int mr, int mc, int kc, P alpha, const TA* a, int lda, P* packed) {
+  for (int i = 0; i < mc; i += mr) {
+    const int rows = std::min(mr, mc - i);
+    for (int p = 0; p < kc; p += Depth) {
+      for (int r = 0; r < rows; ++r) {
+        const TA* row = a + (i + r) * lda + p;
+        for (int d = 0; d < Depth; ++d) {
+          packed[r * Depth + d] =
+              p + d < kc ? static_cast<P>(alpha * static_cast<P>(row[d]))
+                         : P();
+        }
+      }
+      std::fill(packed + rows * Depth, packed + mr * Depth, P());
+      packed += mr * Depth;
+    }
+  }
+}
+
+#ifdef GEMM_X86
+// 把B中连续4行的各8个int8交错为8组，每组为同一列的4个k。
+// 只用到SSE2，x86-64上总是可用
+inline void Interleave4x8(const std::int8_t* b, int ldb, std::int8_t* out) {
+  auto load = [](const std::int8_t* row) {
+    return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row));
+  };
+  const __m128i b01 = _mm_unpacklo_epi8(load(b), load(b + ldb));
+  const __m128i b23 = _mm_unpacklo_epi8(load(b + 2 * ldb), load(b + 3 * ldb));
+  __m128i* dst = reinterpret_cast<__m128i*>(out);
+  _mm_storeu_si128(dst, _mm_unpacklo_epi16(b01, b23));
+  _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(b01, b23));
+}
+#endif  // GEMM_X86
+
+// 把B[0:kc, 0:nc]转换为P，打包为若干个nr列的微面板。
+// 每个微面板内k方向每Depth个元素为一组，按组的顺序存放nr x Depth个元素，
+// 同一列的Depth个元素相邻，不足nr列或不足一组的部分补0
+template <int Depth, typename P, typename TB>
+void PackB(int nr, int kc, int nc, const TB* b, int ldb, P* packed) {
+  for (int j = 0; j < nc; j += nr) {
+    const int cols = std::min(nr, nc - j);
+    for (int p = 0; p < kc; p += Depth) {
+#ifdef GEMM_X86
+      if constexpr (Depth == 4 && std::is_same_v<TB, std::int8_t>) {
+        if (p + 4 <= kc && cols == nr && nr % 8 == 0) {
+          for (int c = 0; c < nr; c += 8) {
+            Interleave4x8(b + p * ldb + j + c, ldb, packed + c * 4);
+          }
+          packed += nr * 4;
+          continue;
+        }
+      }
+#endif  // GEMM_X86
+      for (int d = 0; d < Depth; ++d) {
+        int c = 0;
+        if (p + d < kc) {
+          const TB* row = b + (p + d) * ldb + j;
+          for (; c < cols; ++c) {
+            packed[c * Depth + d] = static_cast<P>(row[c]);
+          }
+        }
+        for (; c < nr; ++c) {
+          packed[c * Depth + d] = P();
+        }
+      }
+      packed += nr * Depth;
+    }
+  }
+}
+
+// 通用微内核，C[0:kMr, 0:kNr] += a * b。
+// 累加器是定长的局部数组，完全展开后编译器可以把它们全部放在向量寄存器中
+template <typename T>
+void MicroKernel(int kc, const T* a, const T* b, T* c, int ldc) {
+  T acc[kMr][kNr] = {};
+  for (int p = 0; p < kc; ++p) {
+#pragma GCC unroll 6
+    for (int r = 0; r < kMr; ++r) {
+      const T a_value = a[r];
+#pragma GCC unroll 16
+      for (int col = 0; col < kNr; ++col) {
+        acc[r][col] += a_value * b[col];
+      }
+    }
+    a += kMr;
+    b += kNr;
+  }
+  for (int r = 0; r < kMr; ++r) {
+    for (int col = 0; col < kNr; ++col) {
+      c[r * ldc + col] += acc[r][col];
+    }
+  }
+}
+
+// int8的通用微内核，C[0:kMr, 0:kNr] += a * b，kc为4的倍数
+inline void MicroKernelInt8(int kc, const std::int8_t* a, const std::int8_t* b,
+                            std::int32_t* c, int ldc) {
+  std::int32_t acc[kMr][kNr] = {};
+  for (int p = 0; p < kc; p += 4) {
+#pragma GCC unroll 6
+    for (int r = 0; r < kMr; ++r) {
+      for (int col = 0; col < kNr; ++col) {
+        for (int d = 0; d < 4; ++d) {
+          acc[r][col] += a[r * 4 + d] * b[col * 4 + d];
+        }
+      }
+    }
+    a += kMr * 4;
+    b += kNr * 4;
+  }
+  for (int r = 0; r < kMr; ++r) {
+    for (int col = 0; col < kNr; ++col) {
+      c[r * ldc + col] += acc[r][col];
+    }
+  }
+}
+
+#ifdef GEMM_X86
+// AVX2的6 x 16微内核：每行的16个累加器放在两个ymm中，共12个，
+// 每步加载B的一行（两个ymm），逐行广播A的元素做FMA
+__attribute__((target("avx2,fma"))) inline void MicroKernelAvx2(
+    int kc, const float* a, const float* b, float* c, int ldc) {
+  constexpr int mr = 6;
+  __m256 acc[mr][2];
+  for (int r = 0; r < mr; ++r) {
+    acc[r][0] = _mm256_setzero_ps();
+    acc[r][1] = _mm256_setzero_ps();
+  }
+  for (int p = 0; p < kc; ++p) {
+    const __m256 b0 = _mm256_loadu_ps(b);
+    const __m256 b1 = _mm256_loadu_ps(b + 8);
+#pragma GCC unroll 6
+    for (int r = 0; r < mr; ++r) {
+      const __m256 a_value = _mm256_broadcast_ss(a + r);
+      acc[r][0] = _mm256_fmadd_ps(a_value, b0, acc[r][0]);
+      acc[r][1] = _mm256_fmadd_ps(a_value, b1, acc[r][1]);
+    }
+    a += mr;
+    b += 16;
+  }
+  for (int r = 0; r < mr; ++r) {
+    float* row = c + r * ldc;
+    _mm256_storeu_ps(row, _mm256_add_ps(_mm256_loadu_ps(row), acc[r][0]));
+    _mm256_storeu_ps(row + 8,
+                     _mm256_add_ps(_mm256_loadu_ps(row + 8), acc[r][1]));
+  }
+}
+
+// AVX-512的12 x 32微内核：32个zmm中24个做累加器，
+// 2个存放B的一行，其余用于广播A
+__attribute__((target("avx512f"))) inline void MicroKernelAvx512(
+    int kc, const float* a, const float* b, float* c, int ldc) {
+  constexpr int mr = 12;
+  __m512 acc[mr][2];
+  for (int r = 0; r < mr; ++r) {
+    acc[r][0] = _mm512_setzero_ps();
+    acc[r][1] = _mm512_setzero_ps();
+  }
+  for (int p = 0; p < kc; ++p) {
+    const __m512 b0 = _mm512_loadu_ps(b);
+    const __m512 b1 = _mm512_loadu_ps(b + 16);
+#pragma GCC unroll 12
+    for (int r = 0; r < mr; ++r) {
+      const __m512 a_value = _mm512_set1_ps(a[r]);
+      acc[r][0] = _mm512_fmadd_ps(a_value, b0, acc[r][0]);
+      acc[r][1] = _mm512_fmadd_ps(a_value, b1, acc[r][1]);
+    }
+    a += mr;
+    b += 32;
+  }
+  for (int r = 0; r < mr; ++r) {
+    float* row = c + r * ldc;
+    _mm512_storeu_ps(row, _mm512_add_ps(_mm512_loadu_ps(row), acc[r][0]));
+    _mm512_storeu_ps(row + 16,
+                     _mm512_add_ps(_mm512_loadu_ps(row + 16), acc[r][1]));
+  }
+}
+
+// 读取打包后A的一组4个int8
+inline std::int32_t LoadGroup(const std::int8_t* a) {
+  std::int32_t group;
+  std::memcpy(&group, a, sizeof(group));
+  return group;
+}
+
+// int8的AVX2 6 x 8微内核。vpmaddubsw的int16中间结果在int8取满范围时
+// 会饱和，所以把A和B都扩展为int16后用vpmaddwd，结果是精确的。
+// B的每组是8列 x 4个k，扩展后两个ymm各含4列，每列占两个int32的部分和，
+// 最后用hadd合并相邻的部分和
+__attribute__((target("avx2"))) inline void MicroKernelInt8Avx2(
+    int kc, const std::int8_t* a, const std::int8_t* b, std::int32_t* c,
+    int ldc) {
+  constexpr int mr = 6;
+  __m256i acc[mr][2];
+  for (int r = 0; r < mr; ++r) {
+    acc[r][0] = _mm256_setzero_si256();
+    acc[r][1] = _mm256_setzero_si256();
+  }
+  for (int p = 0; p < kc; p += 4) {
+    const __m256i b0 = _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(b)));
+    const __m256i b1 = _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 16)));
+#pragma GCC unroll 6
+    for (int r = 0; r < mr; ++r) {
+      const __m256i a_value = _mm256_broadcastq_epi64(
+          _mm_cvtepi8_epi16(_mm_cvtsi32_si128(LoadGroup(a + r * 4))));
+      acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_madd_epi16(a_value, b0));
+      acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_madd_epi16(a_value, b1));
+    }
+    a += mr * 4;
+    b += 32;
+  }
+  for (int r = 0; r < mr; ++r) {
+    // hadd在128位内进行，结果的列顺序为0 1 4 5 2 3 6 7
+    const __m256i sum = _mm256_permute4x64_epi64(
+        _mm256_hadd_epi32(acc[r][0], acc[r][1]), _MM_SHUFFLE(3, 1, 2, 0));
+    __m256i* row = reinterpret_cast<__m256i*>(c + r * ldc);
+    _mm256_storeu_si256(row, _mm256_add_epi32(_mm256_loadu_si256(row), sum));
+  }
+}
+
+// int8的AVX-512 VNNI 12 x 32微内核。vpdpbusd要求一侧为无符号数，
+// 所以A加上128作为uint8：(a + 128) * b = a * b + 128 * b，
+// 同时用vpdpbusd(128, b)累加128倍的B的列和，最后减去
+__attribute__((target("avx512f,avx512vnni"))) inline void MicroKernelInt8Vnni(
+    int kc, const std::int8_t* a, const std::int8_t* b, std::int32_t* c,
+    int ldc) {
+  constexpr int mr = 12;
+  const __m512i offset = _mm512_set1_epi8(static_cast<char>(0x80));
+  __m512i acc[mr][2];
+  for (int r = 0; r < mr; ++r) {
+    acc[r][0] = _mm512_setzero_si512();
+    acc[r][1] = _mm512_setzero_si512();
+  }
+  __m512i sum0 = _mm512_setzero_si512();
+  __m512i sum1 = _mm512_setzero_si512();
+  for (int p = 0; p < kc; p += 4) {
+    const __m512i b0 = _mm512_loadu_si512(b);
+    const __m512i b1 = _mm512_loadu_si512(b + 64);
+    sum0 = _mm512_dpbusd_epi32(sum0, offset, b0);
+    sum1 = _mm512_dpbusd_epi32(sum1, offset, b1);
+#pragma GCC unroll 12
+    for (int r = 0; r < mr; ++r) {
+      const __m512i a_value =
+          _mm512_xor_si512(_mm512_set1_epi32(LoadGroup(a + r * 4)), offset);
+      acc[r][0] = _mm512_dpbusd_epi32(acc[r][0], a_value, b0);
+      acc[r][1] = _mm512_dpbusd_epi32(acc[r][1], a_value, b1);
+    }
+    a += mr * 4;
+    b += 128;
+  }
+  for (int r = 0; r < mr; ++r) {
+    std::int32_t* row = c + r * ldc;
+    _mm512_storeu_si512(
+        row, _mm512_add_epi32(_mm512_loadu_si512(row),
+                              _mm512_sub_epi32(acc[r][0], sum0)));
+    _mm512_storeu_si512(
+        row + 16, _mm512_add_epi32(_mm512_loadu_si512(row + 16),
+                                   _mm512_sub_epi32(acc[r][1], sum1)));
+  }
+}
+#endif  // GEMM_X86
+
+// C = beta * C，beta为0时直接置0
+template <typename T>
+void ScaleC(int m, int n, T beta, T* c, int ldc) {
+  const bool zero = IsZero(beta);
+  for (int i = 0; i < m; ++i) {
+    T* row = c + i * ldc;
+    if (zero) {
+      std::fill(row, row + n, T());
+    } else {
+      for (int j = 0; j < n; ++j) {
+        row[j] *= beta;
+      }
+    }
+  }
+}
+
+// C中不足一个完整tile的边缘：先算到临时的tile上，再累加有效的部分
+template <typename K, typename P, typename T>
+void EdgeKernel(const K& kernel, int rows, int cols, int kc, const P* a,
+                const P* b, T* c, int ldc) {
+  T tile[kMaxMr * kMaxNr] = {};
+  kernel.run(kc, a, b, tile, kernel.nr);
+  for (int r = 0; r < rows; ++r) {
+    for (int col = 0; col < cols; ++col) {
+      c[r * ldc + col] += tile[r * kernel.nr + col];
+    }
+  }
+}
+
+// 打包好的A块（mc x kc）与B块（kc x nc）相乘，累加到C上，
+// kc为按kDepth补齐后的长度
+template <typename K, typename P, typename T>
+void MacroKernel(const K& kernel, int mc, int nc, int kc, const P* packed_a,
+                 const P* packed_b, T* c, int ldc) {
+  const int mr = kernel.mr;
+  const int nr = kernel.nr;
+  for (int j = 0; j < nc; j += nr) {
+    const int cols = std::min(nr, nc - j);
+    const P* b = packed_b + j * kc;
+    for (int i = 0; i < mc; i += mr) {
+      const int rows = std::min(mr, mc - i);
+      const P* a = packed_a + i * kc;
+      T* tile = c + i * ldc + j;
+      if (rows == mr && cols == nr) {
+        kernel.run(kc, a, b, tile, ldc);
+      } else {
+        EdgeKernel(kernel, rows, cols, kc, a, b, tile, ldc);
+      }
+    }
+  }
+}
+
+// 向上取整到multiple的倍数
+constexpr int RoundUp(int value, int multiple) {
+  return (value + multiple - 1) / multiple * multiple;
+}
+
+}  // namespace internal
+
+// 当前CPU支持的所有微内核，第一个是通用版本，最后一个最快
+template <typename T>
+std::vector<Kernel<T>> AvailableKernels() {
+  std::vector<Kernel<T>> kernels = {
+      {"generic", internal::kMr, internal::kNr, &internal::MicroKernel<T>}};
+#ifdef GEMM_X86
+  if constexpr (std::is_same_v<T, float>) {
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      kernels.push_back({"avx2", 6, 16, &internal::MicroKernelAvx2});
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+      kernels.push_back({"avx512", 12, 32, &internal::MicroKernelAvx512});
+    }
+  }
+#endif  // GEMM_X86
+  return kernels;
+}
+
+// Gemm默认使用的微内核，第一次调用时检测CPU
+template <typename T>
+const Kernel<T>& DefaultKernel() {
+  static const Kernel<T> kernel = AvailableKernels<T>().back();
+  return kernel;
+}
+
+// 当前CPU支持的所有int8微内核，第一个是通用版本，最后一个最快
+inline std::vector<Int8Kernel> AvailableInt8Kernels() {
+  std::vector<Int8Kernel> kernels = {
+      {"generic", internal::kMr, internal::kNr, &internal::MicroKernelInt8}};
+#ifdef GEMM_X86
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.push_back({"avx2", 6, 8, &internal::MicroKernelInt8Avx2});
+  }
+  if (__builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512vnni")) {
+    kernels.push_back({"avx512vnni", 12, 32, &internal::MicroKernelInt8Vnni});
+  }
+#endif  // GEMM_X86
+  return kernels;
+}
+
+inline const Int8Kernel& DefaultInt8Kernel() {
+  static const Int8Kernel kernel = AvailableInt8Kernels().back();
+  return kernel;
+}
+
+namespace internal {
+
+// pool为空时单线程计算，否则C按kMc行 x kNt列划分为二维的宏tile，
+// 各线程通过原子计数器动态领取，每个宏tile自己打包A块；
+// 每一轮(jc, pc)的B块由所有线程分段打包后共享。
+// A和B在打包时转换为K::Packed，alpha在打包A时乘上
+template <typename K, typename T, typename TA, typename TB>
+void GemmImpl(ThreadPool* pool, const K& kernel, int m, int n, int k, T alpha,
+              const TA* a, int lda, const TB* b, int ldb, T beta, T* c,
+              int ldc) {
+  static_assert(std::is_same_v<typename K::Value, T>,
+                "kernel does not produce the type of C");
+  using P = typename K::Packed;
+  constexpr int depth = K::kDepth;
+  if (m <= 0 || n <= 0) {
+    return;
+  }
+  const int num_threads = pool == nullptr ? 1 : pool->NumThreads();
+  auto run = [pool](const std::function<void(int)>& fn) {
+    if (pool == nullptr) {
+      fn(0);
+    } else {
+      pool->Run(fn);
+    }
+  };
+  run([&](int thread) {
+    const int begin = m * thread / num_threads;
+    const int end = m * (thread + 1) / num_threads;
+    ScaleC(end - begin, n, beta, c + begin * ldc, ldc);
+  });
+  if (k <= 0 || IsZero(alpha)) {
+    return;
+  }
+
+  const int mr = kernel.mr;
+  const int nr = kernel.nr;
+  std::vector<P> packed_b(RoundUp(std::min(n, kNc), nr) *
+                          RoundUp(std::min(k, kKc), depth));
+  std::vector<std::vector<P>> packed_a(num_threads);
+  for (int jc = 0; jc < n; jc += kNc) {
+    const int nc = std::min(kNc, n - jc);
+    const int num_panels = (nc + nr - 1) / nr;
+    const int row_tiles = (m + kMc - 1) / kMc;
+    const int col_tiles = (nc + kNt - 1) / kNt;
+    for (int pc = 0; pc < k; pc += kKc) {
+      const int kc = std::min(kKc, k - pc);
+      const int padded_kc = RoundUp(kc, depth);
+      run([&](int thread) {
+        const int begin = num_panels * thread / num_threads * nr;
+        const int end =
+            std::min(nc, num_panels * (thread + 1) / num_threads * nr);
+        if (begin < end) {
+          PackB<depth>(nr, kc, end - begin, b + pc * ldb + jc + begin, ldb,
+                       packed_b.data() + begin * padded_kc);
+        }
+      });
+      std::atomic<int> next_tile(0);
+      run([&](int thread) {
+        auto& buffer = packed_a[thread];
+        buffer.resize(RoundUp(std::min(m, kMc), mr) * padded_kc);
+        for (int tile = next_tile++; tile < row_tiles * col_tiles;
+             tile = next_tile++) {
+          const int ic = tile / col_tiles * kMc;
+          const int jt = tile % col_tiles * kNt;
+          const int mc = std::min(kMc, m - ic);
+          PackA<depth>(mr, mc, kc, static_cast<P>(alpha), a + ic * lda + pc,
+                       lda, buffer.data());
+          MacroKernel(kernel, mc, std::min(kNt, nc - jt), padded_kc,
+                      buffer.data(), packed_b.data() + jt * padded_kc,
+                      c + ic * ldc + jc + jt, ldc);
+        }
+      });
+    }
+  }
+}
+
+// 未指定微内核时的入口：int8_t的A、B与int32_t的C且alpha为1时
+// 使用int8微内核，其他情况使用C的类型的微内核
+template <typename T, typename TA, typename TB>
+void DefaultGemm(ThreadPool* pool, int m, int n, int k, T alpha, const TA* a,
+                 int lda, const TB* b, int ldb, T beta, T* c, int ldc) {
+  if constexpr (std::is_same_v<TA, std::int8_t> &&
+                std::is_same_v<TB, std::int8_t> &&
+                std::is_same_v<T, std::int32_t>) {
+    if (alpha == 1) {
+      GemmImpl(pool, DefaultInt8Kernel(), m, n, k, alpha, a, lda, b, ldb,
+               beta, c, ldc);
+      return;
+    }
+  }
+  GemmImpl(pool, DefaultKernel<T>(), m, n, k, alpha, a, lda, b, ldb, beta, c,
+           ldc);
+}
+
+}  // namespace internal
+
+// 使用指定的微内核计算，主要用于测试和基准比较各个微内核
+template <typename T, typename TA, typename TB>
+void Gemm(const Kernel<T>& kernel, int m, int n, int k, T alpha, const TA* a,
+          int lda, const TB* b, int ldb, T beta, T* c, int ldc) {
+  internal::GemmImpl(nullptr, kernel, m, n, k, alpha, a, lda, b, ldb, beta,
+                     c, ldc);
+}
+
+// 使用指定的int8微内核计算C = A * B + beta * C
+inline void Gemm(const Int8Kernel& kernel, int m, int n, int k,
+                 const std::int8_t* a, int lda, const std::int8_t* b, int ldb,
+                 std::int32_t beta, std::int32_t* c, int ldc) {
+  internal::GemmImpl(nullptr, kernel, m, n, k, 1, a, lda, b, ldb, beta, c,
+                     ldc);
+}
+
+template <typename T, typename TA, typename TB>
+void Gemm(int m, int n, int k, T alpha, const TA* a, int lda, const TB* b,
+          int ldb, T beta, T* c, int ldc) {
+  internal::DefaultGemm(nullptr, m, n, k, alpha, a, lda, b, ldb, beta, c,
+                        ldc);
+}
+
+// 在pool的所有线程上并行计算
+template <typename T, typename TA, typename TB>
+void Gemm(ThreadPool& pool, const Kernel<T>& kernel, int m, int n, int k,
+          T alpha, const TA* a, int lda, const TB* b, int ldb, T beta, T* c,
+          int ldc) {
+  internal::GemmImpl(&pool, kernel, m, n, k, alpha, a, lda, b, ldb, beta, c,
+                     ldc);
+}
+
+inline void Gemm(ThreadPool& pool, const Int8Kernel& kernel, int m, int n,
+                 int k, const std::int8_t* a, int lda, const std::int8_t* b,
+                 int ldb, std::int32_t beta, std::int32_t* c, int ldc) {
+  internal::GemmImpl(&pool, kernel, m, n, k, 1, a, lda, b, ldb, beta, c, ldc);
+}
+
+template <typename T, typename TA, typename TB>
+void Gemm(ThreadPool& pool, int m, int n, int k, T alpha, const TA* a, int lda,
+          const TB* b, int ldb, T beta, T* c, int ldc) {
+  internal::DefaultGemm(&pool, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+}
+
+}  // namespace gemm
+
+#endif  // SRC_MATRIX_GEMM_H_
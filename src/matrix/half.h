@@ -0,0 +1,133 @@
+#ifndef SRC_MATRIX_HALF_H_
+#define SRC_MATRIX_HALF_H_
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+
+/*
+ * \brief 16位的浮点数存储类型，只用于存储，计算前转换为float。
+ *   BFloat16: 1位符号、8位指数、7位尾数，即float的高16位，
+ *             范围与float相同，精度约为2到3位十进制有效数字
+ *   Float16:  IEEE 754 binary16，1位符号、5位指数、10位尾数，
+ *             最大值为65504，精度约为3位十进制有效数字
+ * 由float转换时按最近偶数舍入，NaN保持为NaN，超出Float16范围的值变为inf。
+ *
+ * 可以作为Matrix<T>的元素类型，Gemm在打包时把它们转换为float，
+ * 从内存中读取的数据量是float的一半。
+ */
+namespace gemm {
+namespace internal {
+
+inline std::uint32_t FloatBits(float value) {
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+inline float BitsToFloat(std::uint32_t bits) {
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+}  // namespace internal
+
+class BFloat16 {
+ public:
+  BFloat16() = default;
+
+  explicit BFloat16(float value) {
+    const std::uint32_t bits = internal::FloatBits(value);
+    if ((bits & 0x7fffffffU) > 0x7f800000U) {
+      bits_ = static_cast<std::uint16_t>((bits >> 16) | 0x40U);  // quiet NaN
+    } else {
+      const std::uint32_t rounding = 0x7fffU + ((bits >> 16) & 1U);
+      bits_ = static_cast<std::uint16_t>((bits + rounding) >> 16);
+    }
+  }
+
+  explicit operator float() const {
+    return internal::BitsToFloat(static_cast<std::uint32_t>(bits_) << 16);
+  }
+
+  static BFloat16 FromBits(std::uint16_t bits) {
+    BFloat16 value;
+    value.bits_ = bits;
+    return value;
+  }
+
+  std::uint16_t Bits() const { return bits_; }
+
+ private:
+  std::uint16_t bits_ = 0;
+};
+
+class Float16 {
+ public:
+  Float16() = default;
+
+  explicit Float16(float value) {
+    constexpr std::uint32_t kInfinity = 255U << 23;
+    // 舍入后会溢出为inf的最小float
+    constexpr std::uint32_t kOverflow = (127U + 16U) << 23;
+    // 小于2^-14的数转换为非规格化数
+    constexpr std::uint32_t kMinNormal = 113U << 23;
+    const float denormal_magic =
+        internal::BitsToFloat(((127U - 15U) + (23U - 10U) + 1U) << 23);
+    std::uint32_t bits = internal::FloatBits(value);
+    const std::uint32_t sign = bits & 0x80000000U;
+    bits ^= sign;
+    std::uint32_t half;
+    if (bits >= kOverflow) {
+      half = bits > kInfinity ? 0x7e00U : 0x7c00U;
+    } else if (bits < kMinNormal) {
+      // 加上magic后尾数的低位正好是对齐并按最近偶数舍入后的非规格化尾数
+      half = internal::FloatBits(internal::BitsToFloat(bits) +
+                                 denormal_magic) -
+             internal::FloatBits(denormal_magic);
+    } else {
+      const std::uint32_t odd = (bits >> 13) & 1U;
+      bits += (static_cast<std::uint32_t>(15 - 127) << 23) + 0xfffU + odd;
+      half = bits >> 13;
+    }
+    bits_ = static_cast<std::uint16_t>(half | (sign >> 16));
+  }
+
+  // 指数和尾数移到float中对应的位置后乘以2^(127 - 15)，
+  // 规格化数与非规格化数都能得到精确的结果，没有分支，便于向量化。
+  // 依赖非规格化数的乘法，不能在DAZ模式下使用
+  explicit operator float() const {
+    const float scale = internal::BitsToFloat((127U + 127U - 15U) << 23);
+    // 原来为inf或NaN的数乘完后不小于2^16
+    const float inf_or_nan = internal::BitsToFloat((127U + 16U) << 23);
+    const float magnitude =
+        internal::BitsToFloat((bits_ & 0x7fffU) << 13) * scale;
+    const std::uint32_t exponent = magnitude >= inf_or_nan ? 255U << 23 : 0U;
+    return internal::BitsToFloat(internal::FloatBits(magnitude) | exponent |
+                                 ((bits_ & 0x8000U) << 16));
+  }
+
+  static Float16 FromBits(std::uint16_t bits) {
+    Float16 value;
+    value.bits_ = bits;
+    return value;
+  }
+
+  std::uint16_t Bits() const { return bits_; }
+
+ private:
+  std::uint16_t bits_ = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& os, BFloat16 value) {
+  return os << static_cast<float>(value);
+}
+
+inline std::ostream& operator<<(std::ostream& os, Float16 value) {
+  return os << static_cast<float>(value);
+}
+
+}  // namespace gemm
+
+#endif  // SRC_MATRIX_HALF_H_
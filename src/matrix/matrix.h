@@ -3,8 +3,12 @@
 
 #include <algorithm>
 #include <iostream>
+#include <stdexcept>
 #include <utility>
 
+#include "matrix/gemm.h"
+#include "matrix/half.h"
+
 template <typename T>
 class Vector;
 
@@ -14,14 +18,14 @@ class Matrix {
   Matrix() = default;
 
   Matrix(int r, int c) : rows_(r), cols_(c), data_(new T[r * c]()) {
-    std::cout << "construrctor" << std::endl;
+    Trace("construrctor");
   }
 
   Matrix(int r, int c, T* ext_data)
       : rows_(r), cols_(c), data_(ext_data), own_data_(false) {}
 
   Matrix(const Matrix& m) {
-    std::cout << "copy constructor" << std::endl;
+    Trace("copy constructor");
     rows_ = m.rows_;
     cols_ = m.cols_;
     data_ = new T[rows_ * cols_];
@@ -31,7 +35,7 @@ class Matrix {
   }
 
   Matrix(Matrix&& m) noexcept {
-    std::cout << "move constructor" << std::endl;
+    Trace("move constructor");
     this->Swap(m);
   }
 
@@ -43,7 +47,7 @@ class Matrix {
   }
 
   Matrix& operator=(Matrix m) noexcept {
-    std::cout << "copy or move assignment operator" << std::endl;
+    Trace("copy or move assignment operator");
     this->Swap(m);
     return *this;
   }
@@ -88,6 +92,13 @@ class Matrix {
     return sum -= other;
   }
 
+  // 矩阵乘法，两个矩阵的形状不匹配时抛出std::invalid_argument
+  Matrix operator*(const Matrix& other) const {
+    Matrix product(rows_, other.cols_);
+    Gemm(T(1), *this, other, T(0), product);
+    return product;
+  }
+
   Vector<T> operator[](int i) { return Vector<T>{cols_, data_ + i * cols_}; }
 
   const Vector<T> operator[](int i) const {
@@ -119,6 +130,16 @@ class Matrix {
   }
 
  protected:
+  // 定义MATRIX_TRACE时打印构造、拷贝与移动，用于观察特殊成员函数的调用，
+  // 矩阵用于计算时不应有这些输出
+  static void Trace(const char* what) {
+#ifdef MATRIX_TRACE
+    std::cout << what << std::endl;
+#else
+    (void)what;
+#endif
+  }
+
   int rows_ = 0;
   int cols_ = 0;
   T* data_ = nullptr;
@@ -151,6 +172,20 @@ bool operator==(const Matrix<T>& lhs, const Matrix<T>& rhs) {
   return true;
 }
 
+// C = alpha * A * B + beta * C，形状不匹配时抛出std::invalid_argument。
+// A和B的元素类型可以与C不同，例如gemm::BFloat16/gemm::Float16与float，
+// int8_t与int32_t
+template <typename T, typename TA, typename TB>
+void Gemm(T alpha, const Matrix<TA>& a, const Matrix<TB>& b, T beta,
+          Matrix<T>& c) {
+  if (a.Cols() != b.Rows() || c.Rows() != a.Rows() ||
+      c.Cols() != b.Cols()) {
+    throw std::invalid_argument("matrix shapes mismatch in Gemm");
+  }
+  gemm::Gemm(a.Rows(), b.Cols(), a.Cols(), alpha, a.Data(), a.Cols(),
+             b.Data(), b.Cols(), beta, c.Data(), c.Cols());
+}
+
 template <typename T>
 class Vector : public Matrix<T> {
  public:
@@ -2,7 +2,12 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <random>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -74,3 +79,159 @@ TEST(MatrixTest, VectorTest) {
   m[2][2] = 3;
   std::cout << m << std::endl;
 }
+
+namespace {
+
+Matrix<float> RandomMatrix(int rows, int cols, std::mt19937& gen) {
+  std::uniform_real_distribution<float> dist(-1, 1);
+  Matrix<float> m(rows, cols);
+  for (int i = 0; i < rows * cols; i++) {
+    m.Data()[i] = dist(gen);
+  }
+  return m;
+}
+
+// 三重循环的参考实现，用double累加
+Matrix<float> NaiveGemm(float alpha, const Matrix<float>& a,
+                        const Matrix<float>& b, float beta,
+                        const Matrix<float>& c) {
+  Matrix<float> result(c.Rows(), c.Cols());
+  for (int i = 0; i < a.Rows(); i++) {
+    for (int j = 0; j < b.Cols(); j++) {
+      double sum = 0;
+      for (int p = 0; p < a.Cols(); p++) {
+        sum += static_cast<double>(a.At(i, p)) * b.At(p, j);
+      }
+      result.At(i, j) = static_cast<float>(alpha * sum + beta * c.At(i, j));
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(MatrixTest, GemmMatchesNaive) {
+  std::mt19937 gen(42);
+  // 覆盖小于一个tile、非tile整数倍、以及跨越kMc/kKc分块边界的形状
+  const int shapes[][3] = {{1, 1, 1},    {5, 15, 3},    {6, 16, 256},
+                           {37, 53, 71}, {150, 33, 257}, {301, 290, 530}};
+  for (const auto& shape : shapes) {
+    const int m = shape[0];
+    const int n = shape[1];
+    const int k = shape[2];
+    auto a = RandomMatrix(m, k, gen);
+    auto b = RandomMatrix(k, n, gen);
+    auto c = RandomMatrix(m, n, gen);
+    auto expected = NaiveGemm(0.5F, a, b, -2.0F, c);
+    Gemm(0.5F, a, b, -2.0F, c);
+    for (int i = 0; i < m; i++) {
+      for (int j = 0; j < n; j++) {
+        ASSERT_NEAR(c.At(i, j), expected.At(i, j), 1e-4F * k)
+            << m << "x" << n << "x" << k << " at (" << i << ", " << j << ")";
+      }
+    }
+  }
+}
+
+TEST(MatrixTest, GemmZeroBetaIgnoresC) {
+  std::mt19937 gen(7);
+  auto a = RandomMatrix(9, 20, gen);
+  auto b = RandomMatrix(20, 17, gen);
+  Matrix<float> c(9, 17);
+  for (int i = 0; i < 9 * 17; i++) {
+    c.Data()[i] = std::numeric_limits<float>::quiet_NaN();
+  }
+  Gemm(1.0F, a, b, 0.0F, c);
+  auto expected = NaiveGemm(1.0F, a, b, 0.0F, Matrix<float>(9, 17));
+  for (int i = 0; i < 9; i++) {
+    for (int j = 0; j < 17; j++) {
+      EXPECT_NEAR(c.At(i, j), expected.At(i, j), 1e-4F);
+    }
+  }
+}
+
+TEST(MatrixTest, MatrixMultiply) {
+  Matrix<int> m(2, 3);
+  Matrix<int> n(3, 2);
+  for (int i = 0; i < 6; i++) {
+    m.Data()[i] = i + 1;
+    n.Data()[i] = 6 - i;
+  }
+  Matrix<int> expected(2, 2);
+  expected.At(0, 0) = 20;
+  expected.At(0, 1) = 14;
+  expected.At(1, 0) = 56;
+  expected.At(1, 1) = 41;
+  EXPECT_EQ(m * n, expected);
+  EXPECT_THROW(m * m, std::invalid_argument);
+}
+
+TEST(MatrixTest, HalfConversion) {
+  using gemm::BFloat16;
+  using gemm::Float16;
+  EXPECT_EQ(Float16(1.0F).Bits(), 0x3c00);
+  EXPECT_EQ(Float16(-2.0F).Bits(), 0xc000);
+  EXPECT_EQ(Float16(65504.0F).Bits(), 0x7bff);
+  // 65520舍入后超出最大值，变为inf
+  EXPECT_EQ(Float16(65520.0F).Bits(), 0x7c00);
+  EXPECT_EQ(Float16(std::ldexp(1.0F, -24)).Bits(), 0x0001);
+  EXPECT_EQ(Float16(std::ldexp(1.0F, -26)).Bits(), 0x0000);
+  // 1 + 2^-11恰好在1和1 + 2^-10中间，舍入到偶数1
+  EXPECT_EQ(Float16(1.0F + std::ldexp(1.0F, -11)).Bits(), 0x3c00);
+  EXPECT_TRUE(std::isnan(static_cast<float>(
+      Float16(std::numeric_limits<float>::quiet_NaN()))));
+  EXPECT_FLOAT_EQ(static_cast<float>(Float16::FromBits(0x0001)),
+                  std::ldexp(1.0F, -24));
+
+  EXPECT_EQ(BFloat16(1.0F).Bits(), 0x3f80);
+  EXPECT_EQ(BFloat16(1.0F + std::ldexp(1.0F, -8)).Bits(), 0x3f80);
+  EXPECT_EQ(BFloat16(1.0F + std::ldexp(3.0F, -8)).Bits(), 0x3f82);
+  EXPECT_TRUE(std::isnan(static_cast<float>(
+      BFloat16(std::numeric_limits<float>::quiet_NaN()))));
+  EXPECT_EQ(BFloat16(-0.0F).Bits(), 0x8000);
+}
+
+TEST(MatrixTest, GemmMixedPrecision) {
+  std::mt19937 gen(3);
+  auto a = RandomMatrix(37, 53, gen);
+  auto b = RandomMatrix(53, 29, gen);
+  Matrix<gemm::BFloat16> a_bf16(37, 53);
+  Matrix<gemm::BFloat16> b_bf16(53, 29);
+  for (int i = 0; i < 37 * 53; i++) {
+    a_bf16.Data()[i] = gemm::BFloat16(a.Data()[i]);
+    a.Data()[i] = static_cast<float>(a_bf16.Data()[i]);
+  }
+  for (int i = 0; i < 53 * 29; i++) {
+    b_bf16.Data()[i] = gemm::BFloat16(b.Data()[i]);
+    b.Data()[i] = static_cast<float>(b_bf16.Data()[i]);
+  }
+  Matrix<float> c(37, 29);
+  Gemm(2.0F, a_bf16, b_bf16, 0.0F, c);
+  auto expected = NaiveGemm(2.0F, a, b, 0.0F, c);
+  for (int i = 0; i < 37; i++) {
+    for (int j = 0; j < 29; j++) {
+      EXPECT_NEAR(c.At(i, j), expected.At(i, j), 1e-4F * 53);
+    }
+  }
+
+  // alpha为1时使用int8微内核，否则在打包时转换为int32
+  Matrix<std::int8_t> a_int8(3, 2);
+  Matrix<std::int8_t> b_int8(2, 2);
+  const std::int8_t a_values[] = {-128, -128, 127, 1, 0, -1};
+  const std::int8_t b_values[] = {-128, 127, -128, 2};
+  std::copy(a_values, a_values + 6, a_int8.Data());
+  std::copy(b_values, b_values + 4, b_int8.Data());
+  for (std::int32_t alpha : {1, -2}) {
+    Matrix<std::int32_t> c_int32(3, 2);
+    c_int32.At(0, 0) = 10;
+    Gemm(alpha, a_int8, b_int8, 1, c_int32);
+    EXPECT_EQ(c_int32.At(0, 0), 10 + alpha * 32768);
+    EXPECT_EQ(c_int32.At(0, 1), alpha * -16512);
+    EXPECT_EQ(c_int32.At(1, 0), alpha * -16384);
+    EXPECT_EQ(c_int32.At(1, 1), alpha * 16131);
+    EXPECT_EQ(c_int32.At(2, 0), alpha * 128);
+    EXPECT_EQ(c_int32.At(2, 1), alpha * -2);
+  }
+  Matrix<std::int32_t> wrong_shape(2, 2);
+  EXPECT_THROW(Gemm(1, b_int8, a_int8, 0, wrong_shape), std::invalid_argument);
+}
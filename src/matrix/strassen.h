@@ -0,0 +1,166 @@
+#ifndef SRC_MATRIX_STRASSEN_H_
+#define SRC_MATRIX_STRASSEN_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+#include "matrix/gemm.h"
+#include "matrix/thread_pool.h"
+
+/*
+ * \brief Strassen-Winograd算法的矩阵乘法 C = A * B，行主序，
+ * A为m x k，B为k x n。每层递归把三个矩阵各分为2 x 2块，
+ * 用7次子矩阵乘法和15次加减法代替8次乘法，复杂度为O(n^2.81)。
+ * m、n、k中最小的不超过crossover时不再递归，直接调用分块的Gemm。
+ * 某一维为奇数时先对去掉最后一行/列的偶数部分递归，
+ * 再用细长的Gemm补上剩下的部分。
+ *
+ * 递归中的临时矩阵全部来自调用者预先分配的工作区，
+ * 大小由StrassenWorkspaceSize给出，计算过程中不再分配这部分内存。
+ *
+ * \note 与普通的矩阵乘法相比误差更大，且随递归层数增长，
+ * 误差的上界与max|A| * max|B|而不是|A| * |B|成正比，
+ * 行或列的量级相差悬殊时相对误差可能很大。
+ * 实测的误差见READM.md。
+ */
+namespace gemm {
+
+constexpr int kStrassenCrossover = 1024;
+
+// StrassenGemm在该形状下需要的工作区大小（元素个数）
+inline std::size_t StrassenWorkspaceSize(int m, int n, int k, int crossover) {
+  if (std::min({m, n, k}) <= std::max(crossover, 1)) {
+    return 0;
+  }
+  const std::size_t m2 = m / 2;
+  const std::size_t n2 = n / 2;
+  const std::size_t k2 = k / 2;
+  // X存放A的子块之和以及P1（m2 x max(k2, n2)），Y存放B的子块之和
+  return m2 * std::max(k2, n2) + k2 * n2 +
+         StrassenWorkspaceSize(m / 2, n / 2, k / 2, crossover);
+}
+
+namespace internal {
+
+// z = x + y，各自的行间隔为ldx/ldy/ldz，z可以与x或y相同
+template <typename T>
+void Add(int rows, int cols, const T* x, int ldx, const T* y, int ldy, T* z,
+         int ldz) {
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < cols; ++j) {
+      z[i * ldz + j] = x[i * ldx + j] + y[i * ldy + j];
+    }
+  }
+}
+
+// z = x - y
+template <typename T>
+void Sub(int rows, int cols, const T* x, int ldx, const T* y, int ldy, T* z,
+         int ldz) {
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < cols; ++j) {
+      z[i * ldz + j] = x[i * ldx + j] - y[i * ldy + j];
+    }
+  }
+}
+
+template <typename T>
+void Strassen(ThreadPool* pool, int m, int n, int k, const T* a, int lda,
+              const T* b, int ldb, T* c, int ldc, int crossover,
+              T* workspace) {
+  if (std::min({m, n, k}) <= std::max(crossover, 1)) {
+    GemmImpl(pool, DefaultKernel<T>(), m, n, k, T(1), a, lda, b, ldb, T(0),
+             c, ldc);
+    return;
+  }
+  const int m2 = m / 2;
+  const int n2 = n / 2;
+  const int k2 = k / 2;
+  const T* a11 = a;
+  const T* a12 = a + k2;
+  const T* a21 = a + m2 * lda;
+  const T* a22 = a21 + k2;
+  const T* b11 = b;
+  const T* b12 = b + n2;
+  const T* b21 = b + k2 * ldb;
+  const T* b22 = b21 + n2;
+  T* c11 = c;
+  T* c12 = c + n2;
+  T* c21 = c + m2 * ldc;
+  T* c22 = c21 + n2;
+  // X为m2 x max(k2, n2)，Y为k2 x n2，其余的工作区留给下一层递归
+  const int ldx = std::max(k2, n2);
+  T* x = workspace;
+  T* y = x + static_cast<std::size_t>(m2) * ldx;
+  T* rest = y + static_cast<std::size_t>(k2) * n2;
+  auto multiply = [&](const T* lhs, int ld_lhs, const T* rhs, int ld_rhs,
+                      T* out, int ld_out) {
+    Strassen(pool, m2, n2, k2, lhs, ld_lhs, rhs, ld_rhs, out, ld_out,
+             crossover, rest);
+  };
+
+  // 只用两个临时矩阵的调度，见Boyer et al., Memory efficient scheduling
+  // of Strassen-Winograd's matrix multiplication algorithm, 2009，表1
+  Sub(m2, k2, a11, lda, a21, lda, x, ldx);  // S3 = A11 - A21
+  Sub(k2, n2, b22, ldb, b12, ldb, y, n2);   // T3 = B22 - B12
+  multiply(x, ldx, y, n2, c21, ldc);        // P7 = S3 * T3
+  Add(m2, k2, a21, lda, a22, lda, x, ldx);  // S1 = A21 + A22
+  Sub(k2, n2, b12, ldb, b11, ldb, y, n2);   // T1 = B12 - B11
+  multiply(x, ldx, y, n2, c22, ldc);        // P5 = S1 * T1
+  Sub(m2, k2, x, ldx, a11, lda, x, ldx);    // S2 = S1 - A11
+  Sub(k2, n2, b22, ldb, y, n2, y, n2);      // T2 = B22 - T1
+  multiply(x, ldx, y, n2, c12, ldc);        // P6 = S2 * T2
+  Sub(m2, k2, a12, lda, x, ldx, x, ldx);    // S4 = A12 - S2
+  Sub(k2, n2, y, n2, b21, ldb, y, n2);      // T4 = T2 - B21
+  multiply(x, ldx, b22, ldb, c11, ldc);     // P3 = S4 * B22
+  multiply(a11, lda, b11, ldb, x, ldx);     // P1 = A11 * B11
+  Add(m2, n2, x, ldx, c12, ldc, c12, ldc);  // U2 = P1 + P6
+  Add(m2, n2, c12, ldc, c21, ldc, c21, ldc);  // U3 = U2 + P7
+  Add(m2, n2, c12, ldc, c22, ldc, c12, ldc);  // U4 = U2 + P5
+  Add(m2, n2, c21, ldc, c22, ldc, c22, ldc);  // U7 = U3 + P5 = C22
+  Add(m2, n2, c12, ldc, c11, ldc, c12, ldc);  // U5 = U4 + P3 = C12
+  multiply(a22, lda, y, n2, c11, ldc);        // P4 = A22 * T4
+  Sub(m2, n2, c21, ldc, c11, ldc, c21, ldc);  // U6 = U3 - P4 = C21
+  multiply(a12, lda, b21, ldb, c11, ldc);     // P2 = A12 * B21
+  Add(m2, n2, x, ldx, c11, ldc, c11, ldc);    // U1 = P1 + P2 = C11
+
+  // 奇数维的剩余部分，偶数部分记为m' = 2 * m2等
+  if (k % 2 != 0) {
+    // C[0:m', 0:n'] += A[0:m', k - 1] * B[k - 1, 0:n']
+    GemmImpl(pool, DefaultKernel<T>(), 2 * m2, 2 * n2, 1, T(1), a + k - 1,
+             lda, b + (k - 1) * ldb, ldb, T(1), c, ldc);
+  }
+  if (n % 2 != 0) {
+    // C[0:m, n - 1] = A * B[:, n - 1]
+    GemmImpl(pool, DefaultKernel<T>(), m, 1, k, T(1), a, lda, b + n - 1, ldb,
+             T(0), c + n - 1, ldc);
+  }
+  if (m % 2 != 0) {
+    // C[m - 1, 0:n'] = A[m - 1, :] * B[:, 0:n']
+    GemmImpl(pool, DefaultKernel<T>(), 1, 2 * n2, k, T(1),
+             a + (m - 1) * lda, lda, b, ldb, T(0), c + (m - 1) * ldc, ldc);
+  }
+}
+
+}  // namespace internal
+
+// 工作区不足StrassenWorkspaceSize(m, n, k, crossover)时抛出
+// std::invalid_argument。pool不为空时最底层的Gemm在pool上并行
+template <typename T>
+void StrassenGemm(int m, int n, int k, const T* a, int lda, const T* b,
+                  int ldb, T* c, int ldc, int crossover, T* workspace,
+                  std::size_t workspace_size, ThreadPool* pool = nullptr) {
+  if (workspace_size < StrassenWorkspaceSize(m, n, k, crossover)) {
+    throw std::invalid_argument("strassen workspace is too small");
+  }
+  if (m <= 0 || n <= 0) {
+    return;
+  }
+  internal::Strassen(pool, m, n, k, a, lda, b, ldb, c, ldc, crossover,
+                     workspace);
+}
+
+}  // namespace gemm
+
+#endif  // SRC_MATRIX_STRASSEN_H_
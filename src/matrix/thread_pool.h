@@ -0,0 +1,115 @@
+#ifndef SRC_MATRIX_THREAD_POOL_H_
+#define SRC_MATRIX_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gemm {
+
+/*
+ * \brief 常驻线程池，只提供阻塞式的Run和ParallelFor，
+ * 多线程Gemm和autodiff的并行反向传播共用这一个实现。
+ * 调用线程本身作为0号线程参与计算，所以NumThreads()为n的线程池
+ * 只创建n - 1个后台线程。线程在多次调用之间复用，不会反复创建。
+ *
+ * \note Run和ParallelFor不可重入，也不能在多个线程中同时调用。
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads) {
+    for (int i = 1; i < num_threads; ++i) {
+      workers_.emplace_back([this, i]() { WorkerLoop(i); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    start_cv_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  int NumThreads() const { return static_cast<int>(workers_.size()) + 1; }
+
+  // 在每个线程上执行一次fn(thread_index)，全部执行完毕后返回，
+  // 返回时所有线程的写入对调用线程可见，可以当作一次屏障
+  void Run(const std::function<void(int)>& fn) {
+    if (workers_.empty()) {
+      fn(0);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = &fn;
+      pending_ = workers_.size();
+      ++generation_;
+    }
+    start_cv_.notify_all();
+    fn(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this]() { return pending_ == 0; });
+    task_ = nullptr;
+  }
+
+  // 把[0, n)均分为NumThreads()段，fn(begin, end)在各个线程上并行执行，
+  // 所有分段执行完毕后返回
+  void ParallelFor(std::size_t n,
+                   const std::function<void(std::size_t, std::size_t)>& fn) {
+    const auto num_threads = static_cast<std::size_t>(NumThreads());
+    if (n < num_threads) {
+      fn(0, n);
+      return;
+    }
+    Run([n, num_threads, &fn](int index) {
+      const auto chunk = static_cast<std::size_t>(index);
+      fn(n * chunk / num_threads, n * (chunk + 1) / num_threads);
+    });
+  }
+
+ private:
+  void WorkerLoop(int index) {
+    std::size_t seen_generation = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_cv_.wait(lock, [this, seen_generation]() {
+          return stop_ || generation_ != seen_generation;
+        });
+        if (stop_) {
+          return;
+        }
+        seen_generation = generation_;
+      }
+      (*task_)(index);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --pending_;
+      }
+      done_cv_.notify_one();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(int)>* task_ = nullptr;
+  std::size_t pending_ = 0;
+  std::size_t generation_ = 0;
+  bool stop_ = false;
+};
+
+}  // namespace gemm
+
+#endif  // SRC_MATRIX_THREAD_POOL_H_